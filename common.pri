@@ -14,6 +14,16 @@ MOC_DIR = $$DESTDIR/moc
 RCC_DIR = $$DESTDIR/rcc
 UI_DIR = $$DESTDIR/ui
 
+# optional codecs for compressed property files, e.g. qmake CONFIG+=lz4 CONFIG+=zstd
+lz4 {
+    DEFINES += IMDB_WITH_LZ4
+    LIBS += -llz4
+}
+zstd {
+    DEFINES += IMDB_WITH_ZSTD
+    LIBS += -lzstd
+}
+
 INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
@@ -144,6 +144,21 @@ class CmdOption
         return found;
     }
 
+    /**
+     * @brief Check for an option without parameters.
+     *
+     * If the user provided --resume you would get back true
+     */
+    bool parse_flag(const std::vector<std::string>& args)
+    {
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            if (match(args[i])) return true;
+        }
+
+        return false;
+    }
+
     bool match(const std::string& arg)
     {
         return ((is_short_option(arg) && arg.compare(1, arg.length()-1, _short_option) == 0) ||
@@ -14,19 +14,26 @@ ComputeDescriptors::ComputeDescriptors(boost::shared_ptr<Generator> generator, c
     , _finished(false)
 {}
 
-void ComputeDescriptors::add_writer(const std::string& name, boost::shared_ptr<PropertyWriter> writer)
+void ComputeDescriptors::add_writer(const std::string& name, boost::shared_ptr<PropertyWriter> writer, size_t first)
 {
-    _writers.push_back(std::make_pair(name, boost::make_shared<OrderedPushBack>(writer)));
+    _writers.push_back(std::make_pair(name, boost::make_shared<OrderedPushBack>(writer, first)));
 }
 
-bool ComputeDescriptors::start(int num_threads)
+void ComputeDescriptors::add_consumer(const consumer_fn& consumer)
+{
+    _consumers.push_back(consumer);
+}
+
+bool ComputeDescriptors::start(int num_threads, size_t first)
 {
     assert(num_threads > 0);
+    assert(first <= _files.size());
     using namespace boost;
 
     if (_started) return false;
 
     _started = true;
+    _index = first;
     _datetime = QDateTime::currentDateTime();
 
     thread_group pool;
@@ -117,10 +124,22 @@ void ComputeDescriptors::_thread(boost::shared_ptr<Generator> gen)
             return;
         }
 
-        for (std::vector<string_writer_pair>::const_iterator wi = _writers.begin(); wi != _writers.end(); ++wi)
+        // writing fails e.g. if the disk is full, the files written so far can be resumed
+        try
         {
-            anymap_t::const_iterator ri = data.find(wi->first);
-            if (ri != data.end()) wi->second->push_back(current, ri->second);
+            for (std::vector<string_writer_pair>::const_iterator wi = _writers.begin(); wi != _writers.end(); ++wi)
+            {
+                anymap_t::const_iterator ri = data.find(wi->first);
+                if (ri != data.end()) wi->second->push_back(current, ri->second);
+            }
+
+            for (size_t i = 0; i < _consumers.size(); i++) _consumers[i](current, data);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            _error = true;
+            return;
         }
     }
 }
@@ -1,6 +1,7 @@
 #ifndef COMPUTE_DESCRIPTORS_HPP
 #define COMPUTE_DESCRIPTORS_HPP
 
+#include <boost/function.hpp>
 #include <boost/thread.hpp>
 
 #include <QDateTime>
@@ -20,11 +21,24 @@ class ComputeDescriptors
 
     public:
 
+    /// Receives the index of a file and everything the generator computed from it
+    typedef boost::function<void (size_t, const anymap_t&)> consumer_fn;
+
     ComputeDescriptors(boost::shared_ptr<imdb::Generator> generator, const imdb::FileList& files);
 
-    void add_writer(const std::string& name, boost::shared_ptr<imdb::PropertyWriter> writer);
+    /// first is the number of elements the writer already contains, see start()
+    void add_writer(const std::string& name, boost::shared_ptr<imdb::PropertyWriter> writer, size_t first = 0);
+
+    /**
+     * @brief Passes the data computed from each file to consumer, e.g. to quantize descriptors without writing them.
+     *
+     * The consumer is called by all computing threads concurrently and in no particular order, after the data has
+     * been handed to the writers. An exception thrown by the consumer stops the computation.
+     */
+    void add_consumer(const consumer_fn& consumer);
 
-    bool start(int num_threads);
+    /// Computes the descriptors of the files [first, num_files()), e.g. to resume an interrupted computation
+    bool start(int num_threads, size_t first = 0);
 
     size_t current() const;
     bool finished() const;
@@ -38,6 +52,7 @@ class ComputeDescriptors
 
     boost::shared_ptr<imdb::Generator> _generator;
     std::vector<string_writer_pair>    _writers;
+    std::vector<consumer_fn>           _consumers;
     imdb::FileList                     _files;
 
     volatile size_t _index;
@@ -0,0 +1,106 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "float_matrix.hpp"
+
+namespace imdb {
+
+namespace
+{
+
+const char     matrix_magic[4] = {'F', 'M', 'A', 'T'};
+const uint32_t matrix_version = 1;
+
+struct matrix_header
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t rows;
+    uint64_t cols;
+};
+
+} // anonymous namespace
+
+
+FloatMatrixWriter::FloatMatrixWriter(const string& filename, size_t cols)
+    : _ofs(filename.c_str(), std::ofstream::binary|std::ofstream::trunc)
+    , _filename(filename)
+    , _rows(0)
+    , _cols(cols)
+{
+    if (!_ofs.is_open()) throw std::runtime_error("could not open file " + filename);
+
+    // the number of rows is written by close()
+    matrix_header header;
+    std::memcpy(header.magic, matrix_magic, sizeof(header.magic));
+    header.version = matrix_version;
+    header.rows = 0;
+    header.cols = cols;
+    _ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+FloatMatrixWriter::~FloatMatrixWriter()
+{
+    try { close(); }
+    catch (const std::exception&) {}
+}
+
+void FloatMatrixWriter::push_back(const vec_f32_t& row)
+{
+    push_back(row.empty() ? 0 : &row[0], row.size());
+}
+
+void FloatMatrixWriter::push_back(const float* row, size_t size)
+{
+    if (size != _cols) throw std::runtime_error("row size does not match the number of columns of matrix file " + _filename);
+
+    if (_cols > 0) _ofs.write(reinterpret_cast<const char*>(row), _cols * sizeof(float));
+    if (!_ofs.good()) throw std::runtime_error("error while writing file " + _filename);
+    _rows++;
+}
+
+void FloatMatrixWriter::close()
+{
+    if (!_ofs.is_open()) return;
+
+    uint64_t rows = _rows;
+    _ofs.seekp(offsetof(matrix_header, rows));
+    _ofs.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    _ofs.close();
+    if (_ofs.fail()) throw std::runtime_error("error while writing file " + _filename);
+}
+
+
+MappedFloatMatrix::MappedFloatMatrix(const string& filename) : _data(0), _rows(0), _cols(0)
+{
+    try { _file.open(filename); }
+    catch (const std::exception&) { throw std::runtime_error("could not map file " + filename); }
+
+    matrix_header header;
+    if (_file.size() < sizeof(header)) throw std::runtime_error("file " + filename + " is not a matrix file");
+    std::memcpy(&header, _file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, matrix_magic, sizeof(header.magic)) != 0) throw std::runtime_error("file " + filename + " is not a matrix file");
+    if (header.version != matrix_version) throw std::runtime_error("version of file " + filename + " is different from program version");
+    if (_file.size() != sizeof(header) + header.rows * header.cols * sizeof(float)) throw std::runtime_error("matrix file " + filename + " is truncated");
+
+    _data = reinterpret_cast<const float*>(_file.data() + sizeof(header));
+    _rows = header.rows;
+    _cols = header.cols;
+}
+
+void MappedFloatMatrix::get(vec_f32_t& r, size_t i) const
+{
+    r.assign(row(i), row(i) + _cols);
+}
+
+} // namespace imdb
@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef FLOAT_MATRIX_HPP
+#define FLOAT_MATRIX_HPP
+
+#include <fstream>
+
+#include <boost/noncopyable.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "../util/types.hpp"
+
+namespace imdb {
+
+/// \addtogroup io
+/// @{
+
+/**
+ * @brief Writes a dense row-major matrix of floats to disk, one row at a time.
+ *
+ * The file consists of a header (magic "FMAT", uint32 version, uint64 number of rows, uint64
+ * number of columns) followed by all rows without any padding. Use MappedFloatMatrix to read it.
+ * Like property files, matrix files are not portable between machines of differing endianness.
+ */
+class FloatMatrixWriter : boost::noncopyable
+{
+    public:
+
+    /// @throw std::runtime_error if the file cannot be opened
+    FloatMatrixWriter(const string& filename, size_t cols);
+
+    /// Calls close()
+    ~FloatMatrixWriter();
+
+    /// Appends a row, its size must equal the number of columns
+    /// @throw std::runtime_error on write errors or if the row has the wrong size
+    void push_back(const vec_f32_t& row);
+
+    /// Appends the row of size values starting at row, e.g. from an array_view
+    /// @throw std::runtime_error on write errors or if the row has the wrong size
+    void push_back(const float* row, size_t size);
+
+    /// Writes the final number of rows into the header and closes the file
+    void close();
+
+    size_t rows() const { return _rows; }
+    size_t cols() const { return _cols; }
+
+    private:
+
+    std::ofstream _ofs;
+    string        _filename;
+    size_t        _rows;
+    size_t        _cols;
+};
+
+
+/**
+ * @brief Read-only view of a matrix file written with FloatMatrixWriter.
+ *
+ * The file is memory-mapped, i.e. rows are paged in by the operating system on access and the
+ * matrix may be much larger than the main memory. Sequential access is fastest. All methods are
+ * const and may be called concurrently.
+ */
+class MappedFloatMatrix : boost::noncopyable
+{
+    public:
+
+    /// @throw std::runtime_error if the file cannot be mapped or is not a valid matrix file
+    explicit MappedFloatMatrix(const string& filename);
+
+    size_t rows() const { return _rows; }
+    size_t cols() const { return _cols; }
+
+    /// Pointer to the cols() values of row i
+    const float* row(size_t i) const { return _data + i*_cols; }
+
+    /// Copy of row i
+    void get(vec_f32_t& row, size_t i) const;
+
+    private:
+
+    boost::iostreams::mapped_file_source _file;
+
+    const float* _data;
+    size_t       _rows;
+    size_t       _cols;
+};
+
+/// @}
+
+} // namespace imdb
+
+#endif // FLOAT_MATRIX_HPP
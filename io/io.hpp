@@ -17,7 +17,9 @@ the terms of the BSD license (see the LICENSE file).
 
 #include <boost/cstdint.hpp>
 #include <boost/array.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/utility/enable_if.hpp>
 
 namespace imdb {
 
@@ -75,6 +77,21 @@ namespace io
     size_t read(std::istream& is, std::set<T>& v);
 
 
+    // ----------------------------------------------------------------------------
+    // Types whose memory layout equals their serialization, such that a vector of
+    // them is read/written with a single call: arithmetic types and pairs of those
+    // without padding, e.g. the pair<uint32_t, float> of the inverted index lists
+    // ----------------------------------------------------------------------------
+
+    template <class T>
+    struct is_bulk : boost::is_arithmetic<T> {};
+
+    template <class T1, class T2>
+    struct is_bulk<std::pair<T1, T2> >
+        : boost::integral_constant<bool, is_bulk<T1>::value && is_bulk<T2>::value && sizeof(std::pair<T1, T2>) == sizeof(T1) + sizeof(T2)>
+    {};
+
+
     // ----------------------------------------------------------------------------
     // Implementations
     // ----------------------------------------------------------------------------
@@ -165,9 +182,9 @@ namespace io
         // Arithmetic types are all floating points and integral types, see
         // http://www.boost.org/doc/libs/1_48_0/libs/type_traits/doc/html/boost_typetraits/reference/is_arithmetic.html
         //
-        // In case the vector contains arithmetic types we use a more
-        // efficient implementation and write its whole content at once.
-        if (boost::is_arithmetic<T>::value)
+        // In case the vector contains arithmetic types (or pairs of those, see is_bulk)
+        // we use a more efficient implementation and write its whole content at once.
+        if (is_bulk<T>::value)
         {
             size_t num_bytes = v.size()*sizeof(T);
             os.write(reinterpret_cast<const char*>(&v[0]), num_bytes);
@@ -195,7 +212,7 @@ namespace io
         // Specialized function to read in a complete vector<float/double/int>
         // etc. with a single read. This gives us about 4x performance over
         // calling read for all entries separately (the more general case).
-        if (boost::is_arithmetic<T>::value)
+        if (is_bulk<T>::value)
         {
             size_t num_bytes = size*sizeof(T);
             is.read(reinterpret_cast<char*>(&v[0]), num_bytes);
@@ -208,6 +225,90 @@ namespace io
         return t;
     }
 
+    /**
+     * @brief Writes a nested vector as a ragged array: the offsets of the inner vectors into the payload (one more
+     * than there are inner vectors) followed by the payload, i.e. the contents of all inner vectors one after the other.
+     *
+     * Other than write() for nested vectors, the encoding does not interleave sizes and data, such that read_ragged()
+     * can allocate all inner vectors first and then read the payload back to back. Only for vectors of is_bulk types,
+     * e.g. vec_vec_f32_t, and not compatible with read().
+     */
+    template <class T>
+    typename boost::enable_if<is_bulk<T>, size_t>::type
+    write_ragged(std::ostream& os, const std::vector<std::vector<T> >& v)
+    {
+        std::vector<int64_t> offsets(v.size() + 1, 0);
+        for (size_t i = 0; i < v.size(); i++) offsets[i + 1] = offsets[i] + v[i].size();
+
+        size_t t = write(os, offsets);
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            size_t num_bytes = v[i].size()*sizeof(T);
+            if (num_bytes > 0) os.write(reinterpret_cast<const char*>(&v[i][0]), num_bytes);
+            t += num_bytes;
+        }
+        return t;
+    }
+
+    /// Reads a nested vector written by write_ragged(). All inner vectors are sized upfront from the offsets,
+    /// then the payload is read straight into them, without any size fields in between.
+    template <class T>
+    typename boost::enable_if<is_bulk<T>, size_t>::type
+    read_ragged(std::istream& is, std::vector<std::vector<T> >& v)
+    {
+        std::vector<int64_t> offsets;
+        size_t t = read(is, offsets);
+        if (offsets.empty() || !is.good())
+        {
+            v.clear();
+            return t;
+        }
+
+        v.resize(offsets.size() - 1);
+        for (size_t i = 0; i < v.size(); i++) v[i].resize(offsets[i + 1] - offsets[i]);
+
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            size_t num_bytes = v[i].size()*sizeof(T);
+            if (num_bytes > 0) is.read(reinterpret_cast<char*>(&v[i][0]), num_bytes);
+            t += num_bytes;
+        }
+        return t;
+    }
+
+
+    // ----------------------------------------------------------------------------
+    // Rows of dense property files: vectors of is_bulk types whose size is not
+    // stored, as all rows of a file have the same size, see PropertyWriterT::open_dense()
+    // ----------------------------------------------------------------------------
+
+    template <class T>
+    struct is_dense_row : boost::false_type {};
+
+    template <class T>
+    struct is_dense_row<std::vector<T> > : is_bulk<T> {};
+
+    /// Writes the values of v without their number
+    template <class T>
+    typename boost::enable_if<is_bulk<T>, size_t>::type
+    write_row(std::ostream& os, const std::vector<T>& v)
+    {
+        size_t num_bytes = v.size()*sizeof(T);
+        if (num_bytes > 0) os.write(reinterpret_cast<const char*>(&v[0]), num_bytes);
+        return num_bytes;
+    }
+
+    /// Reads a row of num_bytes bytes written by write_row()
+    template <class T>
+    typename boost::enable_if<is_bulk<T>, size_t>::type
+    read_row(std::istream& is, std::vector<T>& v, size_t num_bytes)
+    {
+        v.resize(num_bytes / sizeof(T));
+        if (num_bytes > 0) is.read(reinterpret_cast<char*>(&v[0]), num_bytes);
+        return num_bytes;
+    }
+
+
     template <class T1, class T2>
     size_t write(std::ostream& os, const std::pair<T1, T2>& v)
     {
@@ -246,11 +347,14 @@ namespace io
         v.clear();
         int64_t size = 0;
         s += read(is, size);
+
+        // the elements have been written in order, inserting at the end
+        // with a hint takes constant instead of logarithmic time
         for (int64_t i = 0; i < size; i++)
         {
             T x;
             s += read(is, x);
-            v.insert(x);
+            v.insert(v.end(), x);
         }
         return s;
     }
@@ -279,7 +383,7 @@ namespace io
         {
             std::pair<T1, T2> x;
             s += read(is, x);
-            v.insert(x);
+            v.insert(v.end(), x);
         }
         return s;
     }
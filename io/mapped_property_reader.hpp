@@ -0,0 +1,258 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef MAPPED_PROPERTY_READER_HPP
+#define MAPPED_PROPERTY_READER_HPP
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include "../util/types.hpp"
+#include "property_reader.hpp"
+
+
+namespace imdb {
+
+/**
+ * @addtogroup io
+ * @{
+ */
+
+
+/**
+ * @brief Read-only view of a contiguous array of arithmetic values, e.g. a vec_f32_t stored in a memory-mapped property file.
+ *
+ * Does not own the data, a view is valid as long as the object it has been obtained from.
+ */
+template <class T>
+class array_view
+{
+public:
+
+    typedef T        value_type;
+    typedef const T* const_iterator;
+
+    array_view() : _data(0), _size(0) {}
+    array_view(const T* data, size_t size) : _data(data), _size(size) {}
+
+    const T* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const T& operator[](size_t i) const { assert(i < _size); return _data[i]; }
+
+    const_iterator begin() const { return _data; }
+    const_iterator end() const { return _data + _size; }
+
+    /// Copy of the viewed values
+    std::vector<T> to_vector() const { return std::vector<T>(begin(), end()); }
+
+private:
+
+    const T* _data;
+    size_t   _size;
+};
+
+
+namespace io
+{
+    // Counterparts of io::read for data in memory: fill a view of a serialized vector of arithmetic
+    // values resp. a vector of views of a serialized nested vector, return the end of the serialized data
+
+    template <class T>
+    typename boost::enable_if<boost::is_arithmetic<T>, const char*>::type
+    read_view(const char* p, array_view<T>& v)
+    {
+        // the size may not be aligned, but arithmetic elements are aligned to their
+        // size if all values preceding them in the file are multiples of their size
+        int64_t size;
+        std::memcpy(&size, p, sizeof(size));
+        p += sizeof(size);
+
+        if (reinterpret_cast<size_t>(p) % sizeof(T) != 0) throw std::runtime_error("misaligned data, cannot create view");
+
+        v = array_view<T>(reinterpret_cast<const T*>(p), size);
+        return p + size*sizeof(T);
+    }
+
+    template <class T>
+    typename boost::enable_if<boost::is_arithmetic<T>, const char*>::type
+    read_view(const char* p, std::vector<array_view<T> >& v)
+    {
+        int64_t size;
+        std::memcpy(&size, p, sizeof(size));
+        p += sizeof(size);
+
+        v.resize(size);
+        for (int64_t i = 0; i < size; i++) p = read_view(p, v[i]);
+        return p;
+    }
+
+    // views of the rows of dense files, which are stored without their size
+    template <class T>
+    typename boost::enable_if<boost::is_arithmetic<T>, void>::type
+    read_row_view(const char* p, int64_t num_bytes, array_view<T>& v)
+    {
+        if (reinterpret_cast<size_t>(p) % sizeof(T) != 0) throw std::runtime_error("misaligned data, cannot create view");
+        v = array_view<T>(reinterpret_cast<const T*>(p), num_bytes / sizeof(T));
+    }
+
+    template <class T>
+    void read_row_view(const char*, int64_t, std::vector<array_view<T> >&)
+    {
+        throw std::runtime_error("nested vectors cannot be stored as rows of a dense property file");
+    }
+}
+
+
+/**
+ * @brief Reads a property file generated by PropertyWriterT through a memory mapping of the whole file.
+ *
+ * Has the same interface as PropertyReaderT for reading (copies of) elements. Additionally, view() gives access
+ * to the elements without copying or allocating anything: for T = vector<A> of an arithmetic type A, e.g. a
+ * vec_f32_t, the view is an array_view<A> directly into the mapped file. For T = vector<vector<A> >, e.g. the
+ * vec_vec_f32_t of all local features of an image, it is a vector of such views, one for each inner vector. Its
+ * memory can be reused across calls.
+ *
+ * For dense files (see PropertyWriterT::open_dense()), the rows are views of consecutive parts of the mapping,
+ * i.e. the file is an n x d matrix that is ready to use as soon as it is mapped.
+ *
+ * The operating system pages in the file on access, random access into and full scans of files much larger than
+ * the main memory do not need any buffers or seeks. All methods are const and may be called concurrently.
+ */
+template <class T>
+class MappedPropertyReaderT : public boost::noncopyable
+{
+public:
+
+    /// Construct a reader operating on filename.
+    /// @throw std::runtime_error in case the file cannot be openend or mapped, the file is corrupt, the version does not match
+    /// or the file is compressed
+    MappedPropertyReaderT(const std::string& filename)
+        : _rows(0)
+        , _rowsize(-1)
+    {
+        std::ifstream ifs(filename.c_str(), std::ifstream::binary);
+        if (!ifs.is_open()) throw std::runtime_error("could not open file " + filename);
+        int64_t p_features = read_property_index<T>(ifs, filename, _offset, _map);
+
+        strmap_t::const_iterator it = _map.find("__compression");
+        if (it != _map.end() && it->second != "none")
+        {
+            throw std::runtime_error("file " + filename + " is compressed, use PropertyReaderT to read it");
+        }
+
+        it = _map.find("__layout");
+        if (it != _map.end() && it->second == "dense")
+        {
+            if (!_map.count("__rows") || !_map.count("__rowsize")) throw std::runtime_error("error while reading map in file " + filename);
+            _rows = boost::lexical_cast<index_t>(_map["__rows"]);
+            _rowsize = boost::lexical_cast<int64_t>(_map["__rowsize"]);
+        }
+
+        try { _file.open(filename); }
+        catch (const std::exception&) { throw std::runtime_error("could not map file " + filename); }
+
+        _features = _file.data() + p_features;
+    }
+
+    /// Random access into the file, reading (i.e. copying) the element at position index
+    void get(T& r, index_t index) const
+    {
+        const char* p = element(index);
+        boost::iostreams::stream<boost::iostreams::array_source> is(p, _file.data() + _file.size() - p);
+        if (dense()) detail::read_dense(is, r, _rowsize);
+        else io::read(is, r);
+        assert(is.good());
+    }
+
+    /// Convenience array-style random access, returning the element at position index
+    T operator[] (index_t index) const
+    {
+        T r;
+        get(r, index);
+        return r;
+    }
+
+    /// Hint to the operating system that the file will be read front to back,
+    /// such that pages are read ahead of the accesses
+    void advise_sequential() const
+    {
+#ifndef _WIN32
+        ::posix_madvise(const_cast<char*>(_file.data()), _file.size(), POSIX_MADV_SEQUENTIAL);
+#endif
+    }
+
+    /**
+     * @brief View of the element at position index, without copying.
+     *
+     * V must be array_view<A> for T = vector<A> or vector<array_view<A> > for T = vector<vector<A> >.
+     * @throw std::runtime_error if the element is not properly aligned for A in the mapped file
+     */
+    template <class V>
+    void view(V& v, index_t index) const
+    {
+        if (dense()) io::read_row_view(element(index), _rowsize, v);
+        else io::read_view(element(index), v);
+    }
+
+    index_t size() const
+    {
+        return dense() ? _rows : _offset.size();
+    }
+
+    /// Whether the file has the dense layout
+    bool dense() const
+    {
+        return _rowsize >= 0;
+    }
+
+    const strmap_t& map() const
+    {
+        return _map;
+    }
+
+private:
+
+    const char* element(index_t index) const
+    {
+        assert(index < size());
+        if (dense()) return _features + index*_rowsize;
+
+        assert(_offset[index] >= 0);
+        return _features + _offset[index];
+    }
+
+    boost::iostreams::mapped_file_source _file;
+    const char*                          _features;
+    std::vector<int64_t>                 _offset;
+    strmap_t                             _map;
+
+    // number and size of the rows of dense files, -1 for other files
+    index_t _rows;
+    int64_t _rowsize;
+};
+
+
+/** @} */
+
+} // namespace imdb
+
+#endif // MAPPED_PROPERTY_READER_HPP
@@ -2,13 +2,18 @@
 
 using namespace imdb;
 
-OrderedPushBack::OrderedPushBack(shared_ptr<PropertyWriter> writer)
+OrderedPushBack::OrderedPushBack(shared_ptr<PropertyWriter> writer, std::size_t numWrittenElements)
     : _writer(writer)
-    , _numWrittenElements(0)
+    , _numWrittenElements(numWrittenElements)
 {}
 
 bool OrderedPushBack::push_back(size_t index, const boost::any& element)
 {
+    // serializing is done outside of the lock, i.e. in parallel by all calling threads,
+    // the lock only protects appending the bytes to the writer's buffer
+    shared_ptr<std::string> serialized = make_shared<std::string>();
+    _writer->serialize(element, *serialized);
+
     boost::lock_guard<boost::mutex> locked(_mutex);
 
     // since the things we have written so far is just a linear
@@ -16,12 +21,12 @@ bool OrderedPushBack::push_back(size_t index, const boost::any& element)
     // we get must be at the end or behind of what has been written so far
     assert(index >= _numWrittenElements);
 
-    _queue.push(queue_element(index, make_shared<boost::any>(element)));
+    _queue.push(queue_element(index, serialized));
 
     // *linearly* write stuff into the output vector
     while (!_queue.empty() && _queue.top().first == _numWrittenElements)
     {
-        _writer->push_back(*_queue.top().second);
+        _writer->push_back_serialized(*_queue.top().second);
         _queue.pop();
         _numWrittenElements++;
     }
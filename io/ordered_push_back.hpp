@@ -14,7 +14,8 @@ class OrderedPushBack
 {
     public:
 
-    OrderedPushBack(shared_ptr<PropertyWriter> writer);
+    /// numWrittenElements is the number of elements already in the writer, i.e. the index of the next one
+    OrderedPushBack(shared_ptr<PropertyWriter> writer, std::size_t numWrittenElements = 0);
 
     bool push_back(size_t index, const boost::any& element);
 
@@ -26,8 +27,9 @@ class OrderedPushBack
     std::size_t _numWrittenElements;
     boost::mutex _mutex;
 
-    typedef std::pair<size_t, boost::shared_ptr<boost::any> > queue_element;
-    typedef std::greater<queue_element>                       queue_compare;
+    // serialized elements waiting for their predecessors
+    typedef std::pair<size_t, boost::shared_ptr<std::string> > queue_element;
+    typedef std::greater<queue_element>                        queue_compare;
     typedef std::priority_queue<queue_element, std::vector<queue_element>, queue_compare> queue_t;
 
     queue_t _queue;
@@ -0,0 +1,216 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef PROPERTY_COMPRESSION_HPP
+#define PROPERTY_COMPRESSION_HPP
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#ifdef IMDB_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef IMDB_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace imdb {
+
+/**
+ * @addtogroup io
+ * @{
+ */
+
+
+/**
+ * @brief Block compression settings of a property file written by PropertyWriterT.
+ *
+ * Elements are collected into blocks of (at least) \p blocksize uncompressed bytes, each block is compressed on its
+ * own. LZ4 is fast enough to make reading from disk faster than reading the uncompressed file, Zstd gives better
+ * ratios for archival. The codecs are only available if the library has been built with IMDB_WITH_LZ4 resp.
+ * IMDB_WITH_ZSTD defined (qmake CONFIG+=lz4 resp. CONFIG+=zstd).
+ *
+ * If \p shuffle is > 0, the bytes of each block are regrouped by their position within words of \p shuffle bytes
+ * before compression (first all first bytes, then all second bytes, ...). For floats (shuffle = 4), this puts the
+ * similar sign/exponent bytes next to each other and considerably improves the ratio.
+ */
+struct PropertyCompression
+{
+    enum codec_t
+    {
+        None,
+        LZ4,
+        Zstd
+    };
+
+    PropertyCompression(codec_t codec_ = None, std::size_t blocksize_ = 1 << 20, std::size_t shuffle_ = 0, int level_ = 0)
+        : codec(codec_)
+        , blocksize(blocksize_)
+        , shuffle(shuffle_)
+        , level(level_)
+    {}
+
+    codec_t     codec;
+    std::size_t blocksize;
+    std::size_t shuffle;
+
+    /// Compression level, 0 selects the codec's default. Only used for Zstd.
+    int level;
+
+
+    /// Name of the codec as stored in property files: none, lz4 or zstd
+    std::string name() const
+    {
+        switch (codec)
+        {
+            case LZ4:  return "lz4";
+            case Zstd: return "zstd";
+            default:   return "none";
+        }
+    }
+
+    /// @throw std::runtime_error if name is not a known codec
+    static codec_t codec_from_name(const std::string& name)
+    {
+        if (name == "none") return None;
+        if (name == "lz4")  return LZ4;
+        if (name == "zstd") return Zstd;
+        throw std::runtime_error("unknown compression " + name);
+    }
+
+    /// Whether the library has been built with support for codec
+    static bool available(codec_t codec)
+    {
+        switch (codec)
+        {
+#ifdef IMDB_WITH_LZ4
+            case LZ4:  return true;
+#endif
+#ifdef IMDB_WITH_ZSTD
+            case Zstd: return true;
+#endif
+            case None: return true;
+            default:   return false;
+        }
+    }
+};
+
+
+namespace io
+{
+    // Byte (un)shuffling and (de)compression of the blocks of compressed property files
+
+    /// Regroups the bytes of src by their position within words of width bytes, trailing bytes are copied as is
+    inline void shuffle_bytes(const char* src, std::size_t size, std::size_t width, char* dst)
+    {
+        std::size_t words = size / width;
+        for (std::size_t b = 0; b < width; b++)
+        {
+            for (std::size_t w = 0; w < words; w++) dst[b*words + w] = src[w*width + b];
+        }
+        std::memcpy(dst + words*width, src + words*width, size - words*width);
+    }
+
+    /// Inverse of shuffle_bytes
+    inline void unshuffle_bytes(const char* src, std::size_t size, std::size_t width, char* dst)
+    {
+        std::size_t words = size / width;
+        for (std::size_t b = 0; b < width; b++)
+        {
+            for (std::size_t w = 0; w < words; w++) dst[w*width + b] = src[b*words + w];
+        }
+        std::memcpy(dst + words*width, src + words*width, size - words*width);
+    }
+
+    /// Compresses size bytes of src into dst, which is resized to the compressed size
+    inline void compress_block(const PropertyCompression& compression, const char* src, std::size_t size, std::vector<char>& dst)
+    {
+        std::vector<char> shuffled;
+        if (compression.shuffle > 1)
+        {
+            shuffled.resize(size);
+            if (size > 0) shuffle_bytes(src, size, compression.shuffle, &shuffled[0]);
+            src = shuffled.empty() ? src : &shuffled[0];
+        }
+
+        switch (compression.codec)
+        {
+#ifdef IMDB_WITH_LZ4
+            case PropertyCompression::LZ4:
+            {
+                dst.resize(LZ4_compressBound(static_cast<int>(size)));
+                int n = LZ4_compress_default(src, &dst[0], static_cast<int>(size), static_cast<int>(dst.size()));
+                if (n <= 0) throw std::runtime_error("lz4 compression failed");
+                dst.resize(n);
+                return;
+            }
+#endif
+#ifdef IMDB_WITH_ZSTD
+            case PropertyCompression::Zstd:
+            {
+                dst.resize(ZSTD_compressBound(size));
+                std::size_t n = ZSTD_compress(&dst[0], dst.size(), src, size, compression.level);
+                if (ZSTD_isError(n)) throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(n));
+                dst.resize(n);
+                return;
+            }
+#endif
+            default:
+                // without codecs, the buffers are not used
+                (void)src; (void)size; (void)dst;
+                throw std::runtime_error("compression " + compression.name() + " is not supported by this build");
+        }
+    }
+
+    /// Decompresses size bytes of src into the size() bytes of dst, which must match the uncompressed size
+    inline void decompress_block(const PropertyCompression& compression, const char* src, std::size_t size, std::vector<char>& dst)
+    {
+        std::vector<char> shuffled;
+        std::vector<char>& out = (compression.shuffle > 1) ? shuffled : dst;
+        out.resize(dst.size());
+        if (dst.empty()) return;
+
+        switch (compression.codec)
+        {
+#ifdef IMDB_WITH_LZ4
+            case PropertyCompression::LZ4:
+            {
+                int n = LZ4_decompress_safe(src, &out[0], static_cast<int>(size), static_cast<int>(out.size()));
+                if (n != static_cast<int>(out.size())) throw std::runtime_error("lz4 decompression failed, block is corrupt");
+                break;
+            }
+#endif
+#ifdef IMDB_WITH_ZSTD
+            case PropertyCompression::Zstd:
+            {
+                std::size_t n = ZSTD_decompress(&out[0], out.size(), src, size);
+                if (ZSTD_isError(n) || n != out.size()) throw std::runtime_error("zstd decompression failed, block is corrupt");
+                break;
+            }
+#endif
+            default:
+                (void)src; (void)size;
+                throw std::runtime_error("compression " + compression.name() + " is not supported by this build");
+        }
+
+        if (compression.shuffle > 1) unshuffle_bytes(&shuffled[0], shuffled.size(), compression.shuffle, &dst[0]);
+    }
+}
+
+
+/** @} */
+
+} // namespace imdb
+
+#endif // PROPERTY_COMPRESSION_HPP
@@ -0,0 +1,245 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef PROPERTY_COPY_HPP
+#define PROPERTY_COPY_HPP
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "../util/types.hpp"
+#include "../util/bounded_queue.hpp"
+#include "property_reader.hpp"
+#include "property_writer.hpp"
+
+
+namespace imdb {
+
+/**
+ * @addtogroup io
+ * @{
+ */
+
+
+/**
+ * @brief Copies (ranges of) elements of property files into a new property file without deserializing them.
+ *
+ * Building block of merging, splitting and slicing property files. The serialized elements are copied as they
+ * are, only their offsets are recomputed. Runs of elements stored one after the other are read with a single
+ * read of several megabytes by a background thread, while the output is written by the writer thread of
+ * RawPropertyWriter, such that copying an uncompressed file runs at disk speed. Compressed input files are
+ * decompressed, the output is compressed as requested.
+ *
+ * The output is created by the first call of append(). It gets the type, the map and the layout of the first
+ * input, all further inputs must contain elements of the same type and have the same layout. Dense files cannot
+ * be compressed. The output is complete once the copier is destroyed.
+ *
+ * Typical usage, concatenating two files:
+ * @code
+ * PropertyCopier copier("merged");
+ * copier.append(RawPropertyReader("part0"));
+ * copier.append(RawPropertyReader("part1"));
+ * @endcode
+ */
+class PropertyCopier : public boost::noncopyable
+{
+public:
+
+    /**
+     * @param filename Name of the output, overwritten if it exists
+     * @param compression Compression of the output
+     */
+    PropertyCopier(const std::string& filename, const PropertyCompression& compression = PropertyCompression())
+        : _filename(filename)
+        , _compression(compression)
+        , _open(false)
+    {}
+
+    /**
+     * @brief Appends the elements [begin, end) of input to the output.
+     *
+     * Missing elements of the input, i.e. those that have never been inserted, are missing in the output as well.
+     * @param end End of the range, defaults to the end of the input
+     * @throw std::runtime_error if reading or writing fails or input contains elements of another type than the output
+     */
+    void append(const RawPropertyReader& input, index_t begin = 0, index_t end = -1)
+    {
+        if (end < 0) end = input.size();
+        if (begin < 0 || begin > end || end > input.size()) throw std::runtime_error("invalid range of elements");
+
+        strmap_t::const_iterator it = input.map().find("__typeinfo");
+        if (it == input.map().end()) throw std::runtime_error("cannot copy elements of a file without type info");
+
+        if (!_open)
+        {
+            _writer.open(_filename, _compression, input.map());
+            _typeinfo = it->second;
+            _open = true;
+        }
+        else if (it->second != _typeinfo)
+        {
+            throw std::runtime_error("cannot copy elements of type " + it->second + " into a file of type " + _typeinfo);
+        }
+
+        // rows of dense files are serialized without their size
+        if (input.dense() != _writer.dense()) throw std::runtime_error("cannot copy elements between dense and regular property files");
+
+        index_t first = _writer.size();
+        Reader reader(input, begin, end);
+
+        boost::shared_ptr<chunk_t> chunk;
+        while (reader.next(chunk))
+        {
+            for (size_t k = 0; k < chunk->elements.size(); k++)
+            {
+                const element_t& e = chunk->elements[k];
+                _writer.insert_serialized(chunk->data.empty() ? 0 : &chunk->data[0] + e.position, e.size, first + e.index - begin);
+            }
+        }
+    }
+
+    /// Number of elements in the output so far
+    index_t size() const
+    {
+        return _writer.size();
+    }
+
+private:
+
+    // maximum size of the runs of elements read at once
+    static const int64_t chunk_size = 4 << 20;
+
+    // number of runs read ahead
+    static const std::size_t queue_capacity = 4;
+
+    struct element_t
+    {
+        index_t index;
+        size_t  position;
+        size_t  size;
+    };
+
+    // a run of serialized elements stored one after the other
+    struct chunk_t
+    {
+        std::vector<char>      data;
+        std::vector<element_t> elements;
+    };
+
+    // Reads the runs of elements of a range in the background
+    class Reader : public boost::noncopyable
+    {
+    public:
+
+        Reader(const RawPropertyReader& input, index_t begin, index_t end)
+            : _input(input)
+            , _queue(queue_capacity)
+            , _failed(false)
+        {
+            _input.advise_sequential();
+            _thread = boost::thread(boost::bind(&Reader::read, this, begin, end));
+        }
+
+        ~Reader()
+        {
+            _queue.close();
+            _thread.join();
+        }
+
+        bool next(boost::shared_ptr<chunk_t>& chunk)
+        {
+            if (_queue.pop(chunk)) return true;
+
+            // the queue has been closed by the background thread
+            if (_failed) throw std::runtime_error(_message);
+            return false;
+        }
+
+    private:
+
+        void read(index_t begin, index_t end)
+        {
+            try
+            {
+                index_t i = begin;
+                while (i < end)
+                {
+                    if (_input.offset(i) < 0) { i++; continue; }
+
+                    boost::shared_ptr<chunk_t> chunk = boost::make_shared<chunk_t>();
+                    int64_t offset = _input.offset(i);
+                    int64_t size = 0;
+
+                    for (index_t last = _input.run_end(i, end, chunk_size); i < last; i++)
+                    {
+                        element_t e = { i, static_cast<size_t>(size), static_cast<size_t>(_input.serialized_size(i)) };
+                        chunk->elements.push_back(e);
+                        size += e.size;
+                    }
+
+                    chunk->data.resize(size);
+                    _input.read_serialized(chunk->data, offset);
+                    if (!_queue.push(chunk)) break;
+                }
+            }
+            catch (const std::exception& ex)
+            {
+                _message = ex.what();
+                _failed = true;
+            }
+
+            _queue.close();
+        }
+
+        const RawPropertyReader&                  _input;
+        BoundedQueue<boost::shared_ptr<chunk_t> > _queue;
+        boost::thread                             _thread;
+
+        // set by the background thread before closing the queue
+        bool        _failed;
+        std::string _message;
+    };
+
+    std::string         _filename;
+    PropertyCompression _compression;
+    RawPropertyWriter   _writer;
+    std::string         _typeinfo;
+    bool                _open;
+};
+
+
+/**
+ * @brief Compression of the property file read by reader, e.g. to write copies of it with the same compression.
+ * @param blocksize Block size for the copies, the original block size is not stored in the file
+ */
+inline PropertyCompression compression_of(const RawPropertyReader& reader, std::size_t blocksize = 1 << 20)
+{
+    PropertyCompression compression;
+    compression.blocksize = blocksize;
+
+    strmap_t::const_iterator it = reader.map().find("__compression");
+    if (it != reader.map().end()) compression.codec = PropertyCompression::codec_from_name(it->second);
+
+    it = reader.map().find("__shuffle");
+    if (it != reader.map().end()) compression.shuffle = boost::lexical_cast<std::size_t>(it->second);
+
+    return compression;
+}
+
+
+/** @} */
+
+} // namespace imdb
+
+#endif // PROPERTY_COPY_HPP
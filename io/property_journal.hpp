@@ -0,0 +1,413 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef PROPERTY_JOURNAL_HPP
+#define PROPERTY_JOURNAL_HPP
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/lexical_cast.hpp>
+
+#include "../util/types.hpp"
+#include "io.hpp"
+
+
+namespace imdb {
+
+/**
+ * @addtogroup io
+ * @{
+ */
+
+
+/**
+ * @brief Everything of a property file but the elements: the map, the offsets table and the block index of
+ * compressed files, see PropertyWriterT for the format.
+ */
+struct PropertyIndex
+{
+    PropertyIndex() : dataend(0), rawend(0) {}
+
+    /// Whether the elements are stored in compressed blocks
+    bool compressed() const
+    {
+        strmap_t::const_iterator it = map.find("__compression");
+        return it != map.end() && it->second != "none";
+    }
+
+    /// Whether the elements are rows of equal size stored without offsets table, see PropertyWriterT::open_dense()
+    bool dense() const
+    {
+        strmap_t::const_iterator it = map.find("__layout");
+        return it != map.end() && it->second == "dense";
+    }
+
+    /// Number of elements [0, size) that are all contained in the file, i.e. up to the first missing one
+    index_t prefix_size() const
+    {
+        index_t size = 0;
+        while (size < static_cast<index_t>(offsets.size()) && offsets[size] >= 0) size++;
+        return size;
+    }
+
+    strmap_t             map;
+    std::vector<int64_t> offsets;
+
+    // compressed files only: the position of each block in the file and
+    // of its first byte in the uncompressed data, without the ends
+    std::vector<int64_t> blockpos;
+    std::vector<int64_t> blockstart;
+
+    // end of the element data in the file resp. in the uncompressed data
+    int64_t dataend;
+    int64_t rawend;
+};
+
+
+/**
+ * @brief Writes the index behind the elements, os must be positioned at index.dataend. Completes a property file.
+ */
+inline void write_property_index(std::ostream& os, PropertyIndex& index)
+{
+    int64_t p_features = 0;
+    index.map["__features"] = boost::lexical_cast<std::string>(p_features);
+
+    if (index.compressed())
+    {
+        // the block index is stored including the ends
+        std::vector<int64_t> blockpos(index.blockpos);
+        std::vector<int64_t> blockstart(index.blockstart);
+        blockpos.push_back(index.dataend);
+        blockstart.push_back(index.rawend);
+
+        int64_t p_blocks = os.tellp();
+        index.map["__blocks"] = boost::lexical_cast<std::string>(p_blocks);
+        io::write(os, blockpos);
+        io::write(os, blockstart);
+    }
+
+    // dense files store the number and size of their rows instead of the offsets
+    std::vector<int64_t> empty;
+    if (index.dense())
+    {
+        int64_t rows = index.offsets.size();
+        index.map["__rows"] = boost::lexical_cast<std::string>(rows);
+        index.map["__rowsize"] = boost::lexical_cast<std::string>(rows > 0 ? index.rawend / rows : 0);
+    }
+
+    int64_t p_offsets = os.tellp();
+    index.map["__offsets"] = boost::lexical_cast<std::string>(p_offsets);
+    io::write(os, index.dense() ? empty : index.offsets);
+
+    int64_t p_map = os.tellp();
+    io::write(os, index.map);
+    io::write(os, p_map);
+}
+
+
+/**
+ * @brief Reads the index of a complete property file, i.e. one that has been closed properly.
+ * @throw std::runtime_error if the file cannot be read or is not a property file
+ */
+inline void read_property_index(const std::string& filename, PropertyIndex& index)
+{
+    std::ifstream is(filename.c_str(), std::ifstream::binary);
+    if (!is.is_open()) throw std::runtime_error("could not open file " + filename);
+
+    is.seekg(-static_cast<int>(sizeof(int64_t)), std::ios::end);
+    int64_t p_map;
+    io::read(is, p_map);
+
+    is.seekg(p_map);
+    io::read(is, index.map);
+    if (!is.good() || !index.map.count("__offsets") || !index.map.count("__features"))
+    {
+        throw std::runtime_error("error while reading map in file " + filename);
+    }
+
+    int64_t p_offsets = boost::lexical_cast<int64_t>(index.map["__offsets"]);
+    is.seekg(p_offsets);
+    io::read(is, index.offsets);
+    index.dataend = p_offsets;
+    index.rawend = p_offsets;
+
+    if (index.dense())
+    {
+        if (!index.map.count("__rows") || !index.map.count("__rowsize")) throw std::runtime_error("error while reading map in file " + filename);
+
+        int64_t rows = boost::lexical_cast<int64_t>(index.map["__rows"]);
+        int64_t rowsize = boost::lexical_cast<int64_t>(index.map["__rowsize"]);
+        index.offsets.resize(rows);
+        for (int64_t i = 0; i < rows; i++) index.offsets[i] = i*rowsize;
+    }
+
+    if (index.compressed())
+    {
+        if (!index.map.count("__blocks")) throw std::runtime_error("error while reading map in file " + filename);
+
+        is.seekg(boost::lexical_cast<int64_t>(index.map["__blocks"]));
+        io::read(is, index.blockpos);
+        io::read(is, index.blockstart);
+        if (index.blockpos.empty() || index.blockpos.size() != index.blockstart.size())
+        {
+            throw std::runtime_error("error while reading block index in file " + filename);
+        }
+
+        index.dataend = index.blockpos.back();
+        index.rawend = index.blockstart.back();
+        index.blockpos.pop_back();
+        index.blockstart.pop_back();
+    }
+
+    if (!is.good()) throw std::runtime_error("error while reading file " + filename);
+}
+
+
+/**
+ * @brief Journal of a property file that is being written, stored next to it as <filename>.journal.
+ *
+ * PropertyWriterT only writes the index when the file is closed. To not lose everything if the program dies
+ * before, it regularly appends checkpoints to the journal: the elements and blocks that have been written since
+ * the previous checkpoint, after the data has been synced to disk. read_property_journal() reconstructs the
+ * index of the last complete checkpoint, which makes the file readable again up to that point, see
+ * recover_property(). The journal is removed once the file has been closed properly.
+ *
+ * The journal starts with the map of the file, each checkpoint is enclosed by a marker, such that a checkpoint
+ * torn by a crash is detected.
+ */
+class PropertyJournal
+{
+public:
+
+    static std::string filename(const std::string& property_filename)
+    {
+        return property_filename + ".journal";
+    }
+
+    /// Creates the journal for property_filename, overwriting an existing one
+    void open(const std::string& property_filename, const strmap_t& map)
+    {
+        _filename = filename(property_filename);
+        _ofs.open(_filename.c_str(), std::ofstream::binary|std::ofstream::trunc);
+        if (!_ofs.is_open()) throw std::runtime_error("could not open file " + _filename);
+
+        // a journal without checkpoints is of no use, no need to sync it yet
+        io::write(_ofs, journal_marker());
+        io::write(_ofs, map);
+        _ofs.flush();
+    }
+
+    /**
+     * @brief Appends a checkpoint, the data it refers to must already be on disk.
+     * @param entries Index and offset of each element added since the previous checkpoint
+     * @param blockpos,blockstart Block index of the blocks added since the previous checkpoint
+     */
+    void checkpoint(const std::vector<std::pair<int64_t, int64_t> >& entries, const std::vector<int64_t>& blockpos, const std::vector<int64_t>& blockstart, int64_t dataend, int64_t rawend)
+    {
+        io::write(_ofs, checkpoint_marker());
+        io::write(_ofs, dataend);
+        io::write(_ofs, rawend);
+        io::write(_ofs, blockpos);
+        io::write(_ofs, blockstart);
+        io::write(_ofs, entries);
+        io::write(_ofs, checkpoint_marker());
+        sync();
+    }
+
+    /// Closes and deletes the journal, to be called once the property file is complete
+    void remove()
+    {
+        if (!_ofs.is_open()) return;
+        _ofs.close();
+        std::remove(_filename.c_str());
+    }
+
+    /// Flushes filename to disk (not only to the operating system)
+    static void sync_file(const std::string& filename)
+    {
+#ifndef _WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("could not open file " + filename);
+        int r = ::fsync(fd);
+        ::close(fd);
+        if (r != 0) throw std::runtime_error("could not sync file " + filename);
+#endif
+    }
+
+    // arbitrary values marking the start of a journal and the start and end of each checkpoint
+    static int64_t journal_marker()    { return 0x4c4e524a42444d49LL; }
+    static int64_t checkpoint_marker() { return 0x544e494f504b4843LL; }
+
+private:
+
+    void sync()
+    {
+        _ofs.flush();
+        if (!_ofs.good()) throw std::runtime_error("error while writing file " + _filename);
+        sync_file(_filename);
+    }
+
+    std::string   _filename;
+    std::ofstream _ofs;
+};
+
+
+namespace detail
+{
+    // Reads a vector written by io::write, fails instead of allocating more than the rest of the file
+    template <class T>
+    bool read_bounded(std::istream& is, std::vector<T>& v, int64_t filesize)
+    {
+        int64_t size;
+        io::read(is, size);
+        if (!is.good() || size < 0 || size*static_cast<int64_t>(sizeof(T)) > filesize - static_cast<int64_t>(is.tellg())) return false;
+
+        v.resize(size);
+        if (size > 0) is.read(reinterpret_cast<char*>(&v[0]), size*sizeof(T));
+        return is.good();
+    }
+}
+
+
+/**
+ * @brief Reconstructs the index of a property file from its journal, up to the last complete checkpoint.
+ * @return false if there is no journal for the file, i.e. it has been closed properly or has not been written by PropertyWriterT
+ * @throw std::runtime_error if the journal is corrupt
+ */
+inline bool read_property_journal(const std::string& property_filename, PropertyIndex& index)
+{
+    std::string filename = PropertyJournal::filename(property_filename);
+    std::ifstream is(filename.c_str(), std::ifstream::binary);
+    if (!is.is_open()) return false;
+
+    is.seekg(0, std::ios::end);
+    int64_t filesize = is.tellg();
+    is.seekg(0);
+
+    int64_t marker = 0;
+    io::read(is, marker);
+    if (!is.good() || marker != PropertyJournal::journal_marker()) throw std::runtime_error("file " + filename + " is not a journal");
+
+    index = PropertyIndex();
+    io::read(is, index.map);
+    if (!is.good()) throw std::runtime_error("error while reading map in file " + filename);
+
+    for (;;)
+    {
+        int64_t dataend, rawend;
+        std::vector<int64_t> blockpos, blockstart;
+        std::vector<std::pair<int64_t, int64_t> > entries;
+
+        marker = 0;
+        io::read(is, marker);
+        if (!is.good() || marker != PropertyJournal::checkpoint_marker()) break;
+
+        io::read(is, dataend);
+        io::read(is, rawend);
+        if (!detail::read_bounded(is, blockpos, filesize)) break;
+        if (!detail::read_bounded(is, blockstart, filesize)) break;
+        if (!detail::read_bounded(is, entries, filesize)) break;
+
+        marker = 0;
+        io::read(is, marker);
+        if (!is.good() || marker != PropertyJournal::checkpoint_marker() || blockpos.size() != blockstart.size()) break;
+
+        // the checkpoint is complete, apply it
+        index.dataend = dataend;
+        index.rawend = rawend;
+        index.blockpos.insert(index.blockpos.end(), blockpos.begin(), blockpos.end());
+        index.blockstart.insert(index.blockstart.end(), blockstart.begin(), blockstart.end());
+
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            size_t pos = entries[i].first;
+            if (index.offsets.size() <= pos) index.offsets.resize(pos + 1, -1);
+            index.offsets[pos] = entries[i].second;
+        }
+    }
+
+    return true;
+}
+
+
+/// Truncates or extends filename to size bytes
+inline void resize_file(const std::string& filename, int64_t size)
+{
+#ifdef _WIN32
+    throw std::runtime_error("resizing files is not supported on Windows");
+#else
+    if (::truncate(filename.c_str(), size) != 0) throw std::runtime_error("could not truncate file " + filename);
+#endif
+}
+
+
+/**
+ * @brief Reads the index of a property file, from its journal if it has not been completed.
+ * @return false if the file does not exist
+ */
+inline bool read_property_state(const std::string& filename, PropertyIndex& index)
+{
+    if (read_property_journal(filename, index)) return true;
+    if (!std::ifstream(filename.c_str()).is_open()) return false;
+
+    read_property_index(filename, index);
+    return true;
+}
+
+
+/**
+ * @brief Number of elements [0, n) of a property file that PropertyWriterT::resume() can keep, 0 if the file does not exist.
+ */
+inline index_t resumable_size(const std::string& filename)
+{
+    PropertyIndex index;
+    return read_property_state(filename, index) ? index.prefix_size() : 0;
+}
+
+
+/**
+ * @brief Makes a property file whose writer died readable again, using its journal.
+ *
+ * The file is truncated to the data of the last checkpoint, followed by the corresponding index. Elements
+ * written after the last checkpoint are lost. The journal is removed.
+ * @return Number of elements in the recovered file
+ * @throw std::runtime_error if there is no journal or the file cannot be written
+ */
+inline index_t recover_property(const std::string& filename)
+{
+    PropertyIndex index;
+    if (!read_property_journal(filename, index)) throw std::runtime_error("there is no journal for file " + filename);
+
+    resize_file(filename, index.dataend);
+
+    std::ofstream os(filename.c_str(), std::ofstream::binary|std::ofstream::in|std::ofstream::out);
+    if (!os.is_open()) throw std::runtime_error("could not open file " + filename);
+    os.seekp(index.dataend);
+    write_property_index(os, index);
+    os.close();
+    if (!os) throw std::runtime_error("error while writing file " + filename);
+
+    std::remove(PropertyJournal::filename(filename).c_str());
+    return index.offsets.size();
+}
+
+
+/** @} */
+
+} // namespace imdb
+
+#endif // PROPERTY_JOURNAL_HPP
@@ -9,15 +9,30 @@ the terms of the BSD license (see the LICENSE file).
 #ifndef PROPERTY_HPP
 #define PROPERTY_HPP
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
 #include <boost/iterator/iterator_facade.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/utility.hpp>
 
 #include "../util/types.hpp"
 #include "io.hpp"
+#include "property_compression.hpp"
 #include "type_names.hpp"
 
 
@@ -30,116 +45,549 @@ namespace imdb {
 
 
 /**
- * @brief Class for reading a property file generated by PropertyWriterT.
+ * @brief Reads the index of a property file, i.e. the map and the element offsets, and checks version and element type.
  *
- * Property files are vector-like files, comparable to a std::vector<T>. PropertyReaderT
- * opens such files and gives you efficient random access to single elements T. PropertyReaderT
- * supports all element types T that are implemented in imdb::io as well as arbitrary nestings of those.
- *
- * You are responsible for matching T to the type you used when writing the file. No internal checks
- * are made to avoid mismatches: in that case reading either fails or you will read garbage.
+ * Shared by all readers of property files.
+ * @param is Stream of the property file
+ * @param filename Name of the file, used in error messages
+ * @param offsets Offset of each element, relative to the returned position of the first element
+ * @param map Map stored in the file
+ * @param typeinfo Name of the type the elements must have, empty to accept any type
+ * @return Position of the first element
+ * @throw std::runtime_error in case the file is corrupt, the version does not match or the file contains elements of a different type
  */
+inline int64_t read_property_index(std::istream& is, const std::string& filename, std::vector<int64_t>& offsets, strmap_t& map, const std::string& typeinfo)
+{
+    is.seekg(-static_cast<int>(sizeof(int64_t)), std::ios::end);
+    int64_t p_map;
+    io::read(is, p_map);
+
+    is.seekg(p_map);
+    if (!is.good()) throw std::runtime_error("error while reading file " + filename);
+    io::read(is, map);
+
+
+
+    if (!map.count("__version"))
+    {
+        throw std::runtime_error("error while reading map in file " + filename);
+    }
+
+    // version 3 is the current version, version 2 is version 3 without block compression
+    int p_version  = boost::lexical_cast<int>(map["__version"]);
+    bool ignore_type_info = false;
+    if (p_version != 3 && p_version != 2)
+    {
+
+        // backwards compatibility with version 1 which did not yet have the __typeinfo data
+        if (p_version == 1)
+        {
+            ignore_type_info = true;
+            std::cerr << "PropertyReaderT: warning, file '" << filename << "' has old version 1, ignoring type info." << std::endl;
+        }
+        else
+        {
+            throw std::runtime_error("version of file " + filename + " is different from program version");
+        }
+    }
+
+
+    if (!ignore_type_info)
+    {
+        if (!map.count("__typeinfo"))
+        {
+            throw std::runtime_error("error while reading map in file " + filename + "; map does not contain a __typeinfo entry.");
+        }
+    }
+
+
+    if (!map.count("__features") || !map.count("__offsets"))
+    {
+        throw std::runtime_error("error while reading map in file " + filename);
+    }
+
+    int64_t p_features = boost::lexical_cast<int64_t>(map["__features"]);
+    int64_t p_offsets  = boost::lexical_cast<int64_t>(map["__offsets"]);
+
+
+
+    // backwards compatibility to version 1
+    if (!ignore_type_info && !typeinfo.empty())
+    {
+        string  p_typeinfo = map["__typeinfo"];
+        if (p_typeinfo != typeinfo)
+        {
+            throw std::runtime_error("error: elements stored in property file " + filename + " are of type " + p_typeinfo + ". You are trying to read elements of type " + typeinfo);
+        }
+    }
+
+    is.seekg(p_offsets);
+    if (!is.good()) throw std::runtime_error("error while reading file " + filename);
+    io::read(is, offsets);
+
+    if (!is.good()) throw std::runtime_error("error while reading file " + filename);
+
+    return p_features;
+}
+
+/// read_property_index() for elements of type T
 template <class T>
-class PropertyReaderT : public boost::noncopyable
+int64_t read_property_index(std::istream& is, const std::string& filename, std::vector<int64_t>& offsets, strmap_t& map)
 {
-public:
+    return read_property_index(is, filename, offsets, map, nameof<T>());
+}
 
 
-    // if you change the internal format, be sure to also adapt the writer
-    static int version()
+namespace detail
+{
+    // Deserialization of the rows of dense files, see PropertyWriterT::open_dense()
+    template <class T>
+    typename boost::enable_if<io::is_dense_row<T> >::type
+    read_dense(std::istream& is, T& element, std::size_t num_bytes)
     {
-        return 2;
+        io::read_row(is, element, num_bytes);
     }
 
+    template <class T>
+    typename boost::disable_if<io::is_dense_row<T> >::type
+    read_dense(std::istream&, T&, std::size_t)
+    {
+        throw std::runtime_error("elements of type " + nameof<T>() + " cannot be stored as rows of a dense property file");
+    }
+}
+
+
+/**
+ * @brief Reads the serialized elements of a property file, independent of their type.
+ *
+ * Does all the work of PropertyReaderT except for deserializing the elements. Use it directly to copy elements
+ * between property files without deserializing them, see PropertyCopier. Elements are addressed by their offset
+ * in the uncompressed data and their size, such that runs of elements stored one after the other can be read at
+ * once with read_serialized(). The elements of dense files (see PropertyWriterT::open_dense()) are rows of
+ * row_size() bytes without their size, their offsets follow from their index.
+ *
+ * All const methods may be called concurrently from several threads, see PropertyReaderT.
+ */
+class RawPropertyReader : public boost::noncopyable
+{
+public:
+
 
     /// Construct a reader operating on filename.
-    /// @throw std::runtime_error in case the file cannot be openend, the file is corrupt or the version does not match
-    PropertyReaderT(const std::string& filename)
+    /// @param typeinfo Name of the type the elements must have, empty to accept any type
+    /// @throw std::runtime_error in case the file cannot be openend, the file is corrupt, the version or type does not match
+    /// or the file is compressed with a codec not supported by this build
+    RawPropertyReader(const std::string& filename, const std::string& typeinfo = "")
         : _ifs(filename.c_str(), std::ifstream::binary)
         , _offset(new std::vector<int64_t>())
         , _map(new strmap_t())
+        , _filename(filename)
+        , _cachedblock(0)
+        , _rows(0)
+        , _rowsize(-1)
     {
         if (!_ifs.is_open()) throw std::runtime_error("could not open file " + filename);
+        _p_features = read_property_index(_ifs, filename, *_offset, *_map, typeinfo);
+        read_block_index();
+        read_layout();
+
+        // the elements end where the block index resp. the offsets table starts
+        if (!dense()) compute_sizes(compressed() ? _blockstart.back() : boost::lexical_cast<int64_t>((*_map)["__offsets"]) - _p_features);
+
+#ifndef _WIN32
+        _ifs.close();
+        _fd = ::open(filename.c_str(), O_RDONLY);
+        if (_fd < 0) throw std::runtime_error("could not open file " + filename);
+#endif
+    }
 
-        _ifs.seekg(-static_cast<int>(sizeof(int64_t)), std::ios::end);
-        int64_t p_map;
-        io::read(_ifs, p_map);
+#ifndef _WIN32
+    ~RawPropertyReader()
+    {
+        ::close(_fd);
+    }
+#endif
 
-        _ifs.seekg(p_map);
-        if (!_ifs.good()) throw std::runtime_error("error while reading file " + filename);
-        io::read(_ifs, *_map);
+    /// Hint to the operating system that the file will be read front to back, enlarges its
+    /// read-ahead window. See PropertyScannerT for a sequential scan with read-ahead.
+    void advise_sequential() const
+    {
+#if !defined(_WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
 
+    // Note: the results needs to be an index_t as this
+    // is fixed to be a 64 bit int independent of the system architecture
+    index_t size() const
+    {
+        return dense() ? _rows : _offset->size();
+    }
 
+    const strmap_t& map() const
+    {
+        return *_map;
+    }
+
+    /// Whether the elements are stored in compressed blocks
+    bool compressed() const
+    {
+        return _compression.codec != PropertyCompression::None;
+    }
 
-        if (!_map->count("__version"))
+    /// Whether the file has the dense layout
+    bool dense() const
+    {
+        return _rowsize >= 0;
+    }
+
+    /// Size of the rows of a dense file in bytes
+    int64_t row_size() const
+    {
+        assert(dense());
+        return _rowsize;
+    }
+
+    /// Offset of the element at position index in the (uncompressed) data, -1 if the element is missing
+    int64_t offset(index_t index) const
+    {
+        return dense() ? index*_rowsize : (*_offset)[index];
+    }
+
+    /// Size of the serialized element at position index
+    int64_t serialized_size(index_t index) const
+    {
+        return element_size(index);
+    }
+
+    /**
+     * @brief End of the run of elements starting at begin that are stored one after the other, such that they can be
+     * read at once with read_serialized().
+     *
+     * The run ends at end, before a missing element or once it would exceed max_bytes, but contains at least the
+     * element at begin (which may be missing).
+     */
+    index_t run_end(index_t begin, index_t end, int64_t max_bytes) const
+    {
+        assert(begin < end);
+        if (offset(begin) < 0) return begin + 1;
+
+        int64_t next = offset(begin) + serialized_size(begin);
+        index_t i = begin + 1;
+        while (i < end && offset(i) == next && next + serialized_size(i) - offset(begin) <= max_bytes)
         {
-            throw std::runtime_error("error while reading map in file " + filename);
+            next += serialized_size(i);
+            i++;
         }
+        return i;
+    }
 
-        int p_version  = boost::lexical_cast<int>((*_map)["__version"]);
-        bool ignore_type_info = false;
-        if (p_version != version())
+    /**
+     * @brief Reads buffer.size() bytes of the (uncompressed) data at offset, e.g. a run of serialized elements. Thread-safe.
+     * @throw std::runtime_error if reading fails
+     */
+    void read_serialized(std::vector<char>& buffer, int64_t offset) const
+    {
+        read_serialized(buffer.empty() ? 0 : &buffer[0], buffer.size(), offset);
+    }
+
+    /// Reads size bytes of the (uncompressed) data at offset into buffer. Thread-safe.
+    /// @throw std::runtime_error if reading fails
+    void read_serialized(char* buffer, std::size_t size, int64_t offset) const
+    {
+        if (!compressed())
         {
+            read_raw(buffer, size, _p_features + offset);
+            return;
+        }
 
-            // backwards compatibility with version 1 which did not yet have the __typeinfo data
-            if (p_version == 1)
-            {
-                ignore_type_info = true;
-                std::cerr << "PropertyReaderT: warning, file '" << filename << "' has old version 1, ignoring type info." << std::endl;
-            }
-            else
-            {
-                throw std::runtime_error("version of file " + filename + " is different from program version");
-            }
+        size_t done = 0;
+        size_t b = std::upper_bound(_blockstart.begin(), _blockstart.end(), offset) - _blockstart.begin() - 1;
+        while (done < size)
+        {
+            if (b + 1 >= _blockstart.size()) throw std::runtime_error("error while reading file " + _filename);
+
+            boost::shared_ptr<const std::vector<char> > block = read_block(b);
+            size_t begin = offset + done - _blockstart[b];
+            size_t n = std::min(size - done, block->size() - begin);
+            std::memcpy(buffer + done, &(*block)[begin], n);
+            done += n;
+            b++;
+        }
+    }
+
+protected:
+
+    void read_layout()
+    {
+        strmap_t::const_iterator it = _map->find("__layout");
+        if (it == _map->end() || it->second != "dense") return;
+
+        if (compressed() || !_map->count("__rows") || !_map->count("__rowsize")) throw std::runtime_error("error while reading map in file " + _filename);
+        _rows = boost::lexical_cast<index_t>((*_map)["__rows"]);
+        _rowsize = boost::lexical_cast<int64_t>((*_map)["__rowsize"]);
+    }
+
+    void read_block_index()
+    {
+        strmap_t::const_iterator it = _map->find("__compression");
+        if (it == _map->end()) return;
+
+        _compression.codec = PropertyCompression::codec_from_name(it->second);
+        if (!compressed()) return;
+
+        if (!PropertyCompression::available(_compression.codec))
+        {
+            throw std::runtime_error("file " + _filename + " is compressed with " + it->second + ", which is not supported by this build");
         }
 
+        if (!_map->count("__blocks")) throw std::runtime_error("error while reading map in file " + _filename);
+        if (_map->count("__shuffle")) _compression.shuffle = boost::lexical_cast<size_t>((*_map)["__shuffle"]);
 
-        if (!ignore_type_info)
+        _ifs.seekg(boost::lexical_cast<int64_t>((*_map)["__blocks"]));
+        io::read(_ifs, _blockpos);
+        io::read(_ifs, _blockstart);
+        if (!_ifs.good() || _blockpos.empty() || _blockpos.size() != _blockstart.size())
         {
-            if (!_map->count("__typeinfo"))
-            {
-                throw std::runtime_error("error while reading map in file " + filename + "; map does not contain a __typeinfo entry.");
-            }
+            throw std::runtime_error("error while reading block index in file " + _filename);
         }
+    }
+
+    // Decompressed data of block b, shared with the cache of the most recently used block
+    boost::shared_ptr<const std::vector<char> > read_block(size_t b) const
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(_blockmutex);
+            if (_cached && _cachedblock == b) return _cached;
+        }
+
+        std::vector<char> data(_blockpos[b + 1] - _blockpos[b]);
+        read_raw(data.empty() ? 0 : &data[0], data.size(), _p_features + _blockpos[b]);
+
+        boost::shared_ptr<std::vector<char> > block = boost::make_shared<std::vector<char> >(_blockstart[b + 1] - _blockstart[b]);
+        io::decompress_block(_compression, data.empty() ? 0 : &data[0], data.size(), *block);
+
+        boost::lock_guard<boost::mutex> lock(_blockmutex);
+        _cachedblock = b;
+        _cached = block;
+        return block;
+    }
+
+    void read_raw(char* buffer, std::size_t size, int64_t position) const
+    {
+#ifdef _WIN32
+        boost::lock_guard<boost::mutex> lock(_mutex);
+        _ifs.seekg(position);
+        if (size > 0) _ifs.read(buffer, size);
+        if (!_ifs.good()) throw std::runtime_error("error while reading file " + _filename);
+#else
+        read_at(buffer, size, position);
+#endif
+    }
+
+    // Elements are usually written one after the other, such that the size of an element is the difference to
+    // the offset of the next one. Only if elements have been inserted out of order their sizes are stored.
+    void compute_sizes(int64_t end)
+    {
+        const std::vector<int64_t>& offset = *_offset;
+        _end = end;
 
+        bool sorted = true;
+        for (size_t i = 1; i < offset.size() && sorted; i++) sorted = offset[i - 1] <= offset[i];
+        if (sorted) return;
 
-        if (!_map->count("__features") || !_map->count("__offsets"))
+        std::vector<std::pair<int64_t, size_t> > order;
+        for (size_t i = 0; i < offset.size(); i++)
         {
-            throw std::runtime_error("error while reading map in file " + filename);
+            if (offset[i] >= 0) order.push_back(std::make_pair(offset[i], i));
         }
+        std::sort(order.begin(), order.end());
 
-        int64_t p_features = boost::lexical_cast<int64_t>((*_map)["__features"]);
-        int64_t p_offsets  = boost::lexical_cast<int64_t>((*_map)["__offsets"]);
+        _size.assign(offset.size(), 0);
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            int64_t next = (k + 1 < order.size()) ? order[k + 1].first : end;
+            _size[order[k].second] = next - order[k].first;
+        }
+    }
 
+    int64_t element_size(index_t index) const
+    {
+        if (dense()) return _rowsize;
+        if (!_size.empty()) return _size[index];
 
+        const std::vector<int64_t>& offset = *_offset;
+        int64_t next = (index + 1 < static_cast<index_t>(offset.size())) ? offset[index + 1] : _end;
+        return next - offset[index];
+    }
+
+    // buffer of the calling thread for reading single elements, shared by all readers
+    static std::vector<char>& thread_buffer()
+    {
+        static boost::thread_specific_ptr<std::vector<char> > buffer;
+        if (!buffer.get()) buffer.reset(new std::vector<char>());
+        return *buffer;
+    }
 
-        // backwards compatibility to version 1
-        if (!ignore_type_info)
+#ifndef _WIN32
+    void read_at(char* buffer, std::size_t size, int64_t position) const
+    {
+        size_t done = 0;
+        while (done < size)
         {
-            string  p_typeinfo = (*_map)["__typeinfo"];
-            string  t_typeinfo = nameof<T>();
-            if (p_typeinfo != t_typeinfo)
-            {
-                throw std::runtime_error("error: elements stored in property file " + filename + " are of type " + p_typeinfo + ". You are trying to read elements of type " + t_typeinfo);
-            }
+            ssize_t n = ::pread(_fd, buffer + done, size - done, position + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("error while reading file " + _filename);
+            done += n;
         }
+    }
+#endif
 
-        _ifs.seekg(p_offsets);
-        if (!_ifs.good()) throw std::runtime_error("error while reading file " + filename);
-        io::read(_ifs, *_offset);
+    mutable std::ifstream                    _ifs;
+    boost::shared_ptr<std::vector<int64_t> > _offset;
+    boost::shared_ptr<strmap_t>              _map;
+    int64_t                                  _p_features;
+    std::string                              _filename;
+
+    // block index of compressed files: the position of each block relative to _p_features resp. of
+    // its first byte in the uncompressed data, which the offsets refer to, each followed by the end
+    PropertyCompression  _compression;
+    std::vector<int64_t> _blockpos;
+    std::vector<int64_t> _blockstart;
+
+    // the most recently decompressed block
+    mutable boost::mutex                                _blockmutex;
+    mutable size_t                                      _cachedblock;
+    mutable boost::shared_ptr<const std::vector<char> > _cached;
+
+    // end of the last element in the (uncompressed) data and, only for files
+    // whose elements are not stored in index order, the size of each element
+    int64_t              _end;
+    std::vector<int64_t> _size;
+
+    // number and size of the rows of dense files, which do not have offsets, -1 for other files
+    index_t _rows;
+    int64_t _rowsize;
+
+#ifdef _WIN32
+    mutable boost::mutex _mutex;
+#else
+    int _fd;
+#endif
+};
 
-        if (!_ifs.good()) throw std::runtime_error("error while reading file " + filename);
 
-        _p_features = p_features;
+/**
+ * @brief Class for reading a property file generated by PropertyWriterT.
+ *
+ * Property files are vector-like files, comparable to a std::vector<T>. PropertyReaderT
+ * opens such files and gives you efficient random access to single elements T. PropertyReaderT
+ * supports all element types T that are implemented in imdb::io as well as arbitrary nestings of those.
+ *
+ * You are responsible for matching T to the type you used when writing the file. No internal checks
+ * are made to avoid mismatches: in that case reading either fails or you will read garbage.
+ *
+ * All const methods, in particular get(), may be called concurrently from several threads on a shared reader.
+ * Each call reads its element with a single positional read (pread) into a buffer of the calling thread, i.e. there
+ * is no shared file position. On Windows, calls are serialized by a mutex instead. To read many consecutive elements,
+ * use get_range(), read_property() or PropertyScannerT, which read runs of elements at once.
+ *
+ * Files with compressed blocks (see PropertyCompression) are decompressed transparently. get() decompresses the
+ * whole block containing the element, the most recently decompressed block is kept such that sequential reads
+ * decompress each block only once.
+ */
+template <class T>
+class PropertyReaderT : public RawPropertyReader
+{
+public:
+
+
+    // if you change the internal format, be sure to also adapt the writer
+    static int version()
+    {
+        return 3;
     }
 
-    /// Random access into the file, reading the element at position index
+
+    /// Construct a reader operating on filename.
+    /// @throw std::runtime_error in case the file cannot be openend, the file is corrupt, the version does not match
+    /// or the file is compressed with a codec not supported by this build
+    PropertyReaderT(const std::string& filename)
+        : RawPropertyReader(filename, nameof<T>())
+    {}
+
+    /// Random access into the file, reading the element at position index. Thread-safe.
+    /// @throw std::runtime_error if reading fails or the element is missing, i.e. has never been written
     void get(T& r, index_t index) const
     {
-        int64_t p = _p_features + (*_offset)[index];
+        if (offset(index) < 0) throw std::runtime_error("element " + boost::lexical_cast<std::string>(index) + " is missing in file " + _filename);
+
+        if (compressed())
+        {
+            // elements never span blocks, find the block that contains the element's offset
+            int64_t offset = this->offset(index);
+            size_t b = std::upper_bound(_blockstart.begin(), _blockstart.end(), offset) - _blockstart.begin() - 1;
+            assert(b + 1 < _blockstart.size());
+
+            boost::shared_ptr<const std::vector<char> > block = read_block(b);
+            size_t begin = offset - _blockstart[b];
+
+            boost::iostreams::stream<boost::iostreams::array_source> is(&(*block)[begin], block->size() - begin);
+            io::read(is, r);
+            if (is.fail()) throw std::runtime_error("error while reading file " + _filename);
+            return;
+        }
+
+        int64_t p = _p_features + offset(index);
+
+#ifdef _WIN32
+        boost::lock_guard<boost::mutex> lock(_mutex);
         if (p != _ifs.tellg()) _ifs.seekg(p);
-        io::read(_ifs, r);
-        assert(_ifs.good());
+        read_element(_ifs, r);
+        if (!_ifs.good()) throw std::runtime_error("error while reading property file");
+#else
+        std::vector<char>& buffer = thread_buffer();
+        buffer.resize(element_size(index));
+        read_at(buffer.empty() ? 0 : &buffer[0], buffer.size(), p);
+
+        boost::iostreams::stream<boost::iostreams::array_source> is(buffer.empty() ? 0 : &buffer[0], buffer.size());
+        read_element(is, r);
+        if (is.fail()) throw std::runtime_error("error while reading file " + _filename);
+#endif
+    }
+
+
+    /**
+     * @brief Reads the elements [begin, end) into values, which is resized to end - begin. Thread-safe.
+     *
+     * Runs of elements stored one after the other are read at once, with reads of a few megabytes, instead of
+     * reading each element on its own as get() does. Use it to read many consecutive elements.
+     * @throw std::runtime_error if reading fails or the range is invalid
+     */
+    void get_range(std::vector<T>& values, index_t begin, index_t end) const
+    {
+        if (begin < 0 || begin > end || end > size()) throw std::runtime_error("invalid range of elements");
+        values.resize(end - begin);
+
+        std::vector<char> buffer;
+        index_t i = begin;
+        while (i < end)
+        {
+            index_t last = run_end(i, end, run_size);
+            if (offset(i) < 0)
+            {
+                get(values[i - begin], i);
+                i = last;
+                continue;
+            }
+
+            buffer.resize(offset(last - 1) + serialized_size(last - 1) - offset(i));
+            read_serialized(buffer, offset(i));
+
+            boost::iostreams::stream<boost::iostreams::array_source> is(buffer.empty() ? 0 : &buffer[0], buffer.size());
+            for (; i < last; i++) read_element(is, values[i - begin]);
+            if (is.fail()) throw std::runtime_error("error while reading file " + _filename);
+        }
     }
 
 
@@ -206,24 +654,17 @@ public:
     const_iterator begin() { return const_iterator(*this, 0); }
     const_iterator end() { return const_iterator(*this, this->size()); }
 
-    // Note: the results needs to be an index_t as this
-    // is fixed to be a 64 bit int independent of the system architecture
-    index_t size() const
-    {
-        return _offset->size();
-    }
+private:
 
-    const strmap_t& map() const
+    // maximum number of bytes read at once by get_range()
+    static const int64_t run_size = 4 << 20;
+
+    // dense files are not compressed, their rows are stored without size
+    void read_element(std::istream& is, T& r) const
     {
-        return *_map;
+        if (dense()) detail::read_dense(is, r, _rowsize);
+        else io::read(is, r);
     }
-
-private:
-
-    mutable std::ifstream                    _ifs;
-    boost::shared_ptr<std::vector<int64_t> > _offset;
-    boost::shared_ptr<strmap_t>              _map;
-    int64_t                                  _p_features;
 };
 
 
@@ -235,8 +676,27 @@ template <class T>
 void read_property(std::vector<T>& v, const std::string& filename)
 {
     PropertyReaderT<T> rd(filename);
-    v.resize(rd.size());
-    for (index_t i = 0; i < rd.size(); i++) rd.get(v[i], i);
+    rd.advise_sequential();
+    rd.get_range(v, 0, rd.size());
+}
+
+/**
+ * @brief Reads a dense property file of vector<A> (see PropertyWriterT::open_dense()) at once into a row-major matrix.
+ *
+ * Other than read_property(), which allocates a vector for each row, this is a single read into a single vector.
+ * @param values Values of all rows, one row after the other
+ * @return Number of values per row
+ * @throw std::runtime_error if the file cannot be read, contains elements of another type or is not dense
+ */
+template <class A>
+std::size_t read_dense_property(std::vector<A>& values, const std::string& filename)
+{
+    RawPropertyReader rd(filename, nameof<std::vector<A> >());
+    if (!rd.dense()) throw std::runtime_error("file " + filename + " is not a dense property file");
+
+    values.resize(rd.size()*rd.row_size() / sizeof(A));
+    rd.read_serialized(reinterpret_cast<char*>(values.empty() ? 0 : &values[0]), values.size()*sizeof(A), 0);
+    return rd.row_size() / sizeof(A);
 }
 
 
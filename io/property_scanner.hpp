@@ -0,0 +1,160 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef PROPERTY_SCANNER_HPP
+#define PROPERTY_SCANNER_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "../util/types.hpp"
+#include "../util/bounded_queue.hpp"
+#include "property_reader.hpp"
+
+
+namespace imdb {
+
+/**
+ * @addtogroup io
+ * @{
+ */
+
+
+/**
+ * @brief Sequential scan over (a range of) a property file with asynchronous read-ahead.
+ *
+ * A background thread reads the elements in file order and keeps up to \p capacity decoded elements ready, such
+ * that reading from disk overlaps with whatever the consumer does with the elements. Runs of elements stored one
+ * after the other are read at once with reads of up to a few megabytes (see PropertyReaderT::get_range()). The operating system is
+ * told that the file is read sequentially, which enlarges its read-ahead window.
+ *
+ * Typical usage:
+ * @code
+ * PropertyReaderT<vec_f32_t> reader(filename);
+ * PropertyScannerT<vec_f32_t> scanner(reader);
+ * vec_f32_t element;
+ * while (scanner.next(element)) process(element);
+ * @endcode
+ *
+ * The reader must stay valid during the lifetime of the scanner, it may be used by other threads concurrently.
+ * A scanner itself must only be used by a single consumer thread.
+ */
+template <class T>
+class PropertyScannerT : public boost::noncopyable
+{
+public:
+
+    /**
+     * @brief Starts reading the elements [begin, end) of reader in the background.
+     * @param capacity Maximum number of elements read ahead
+     * @param end End of the range, defaults to the end of the file
+     */
+    PropertyScannerT(const PropertyReaderT<T>& reader, std::size_t capacity = 16, index_t begin = 0, index_t end = -1)
+        : _reader(reader)
+        , _queue(capacity)
+        , _next(begin)
+        , _end(end < 0 ? reader.size() : end)
+        , _failed(false)
+    {
+        _reader.advise_sequential();
+        _thread = boost::thread(boost::bind(&PropertyScannerT::read, this, begin));
+    }
+
+    /// Stops the background thread, also if not all elements have been consumed
+    ~PropertyScannerT()
+    {
+        _queue.close();
+        _thread.join();
+    }
+
+    /**
+     * @brief Returns the next element in file order.
+     * @param index Position of the element in the file
+     * @return false once all elements of the range have been returned
+     * @throw std::runtime_error if the background thread failed to read an element
+     */
+    bool next(T& element, index_t& index)
+    {
+        boost::shared_ptr<T> e;
+        if (!_queue.pop(e))
+        {
+            // the queue has been closed by the background thread
+            if (_failed) throw std::runtime_error(_message);
+            return false;
+        }
+
+        std::swap(element, *e);
+        index = _next++;
+        return true;
+    }
+
+    /// Returns the next element in file order, false once all elements of the range have been returned
+    bool next(T& element)
+    {
+        index_t index;
+        return next(element, index);
+    }
+
+private:
+
+    // maximum number of bytes read at once
+    static const int64_t run_size = 4 << 20;
+
+    void read(index_t begin)
+    {
+        try
+        {
+            // runs of elements are read at once, then handed out one by one
+            if (begin < 0 || begin > _end || _end > _reader.size()) throw std::runtime_error("invalid range of elements");
+
+            std::vector<T> run;
+            bool open = true;
+            for (index_t i = begin; i < _end && open; )
+            {
+                index_t last = _reader.run_end(i, _end, run_size);
+                _reader.get_range(run, i, last);
+
+                for (size_t k = 0; k < run.size() && open; k++, i++)
+                {
+                    boost::shared_ptr<T> e = boost::make_shared<T>();
+                    std::swap(*e, run[k]);
+                    open = _queue.push(e);
+                }
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            _message = ex.what();
+            _failed = true;
+        }
+
+        _queue.close();
+    }
+
+    const PropertyReaderT<T>&             _reader;
+    BoundedQueue<boost::shared_ptr<T> >   _queue;
+    boost::thread                         _thread;
+    index_t                               _next;
+    index_t                               _end;
+
+    // set by the background thread before closing the queue
+    bool        _failed;
+    std::string _message;
+};
+
+
+/** @} */
+
+} // namespace imdb
+
+#endif // PROPERTY_SCANNER_HPP
@@ -9,8 +9,23 @@ the terms of the BSD license (see the LICENSE file).
 #ifndef PROPERTY_WRITER_HPP
 #define PROPERTY_WRITER_HPP
 
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
 #include "../util/types.hpp"
+#include "../util/bounded_queue.hpp"
 #include "io.hpp"
+#include "property_compression.hpp"
+#include "property_journal.hpp"
 #include "type_names.hpp"
 
 
@@ -20,6 +35,25 @@ namespace imdb {
 /// @{
 
 
+namespace detail
+{
+    // Serialization of the rows of dense files, only element types with io::is_dense_row can be stored as such
+    template <class T>
+    typename boost::enable_if<io::is_dense_row<T> >::type
+    write_dense(std::ostream& os, const T& element)
+    {
+        io::write_row(os, element);
+    }
+
+    template <class T>
+    typename boost::disable_if<io::is_dense_row<T> >::type
+    write_dense(std::ostream&, const T&)
+    {
+        throw std::runtime_error("elements of type " + nameof<T>() + " cannot be stored as rows of a dense property file");
+    }
+}
+
+
 /**
   * @brief Interface for templated PropertyWriterT.
   *
@@ -32,8 +66,437 @@ struct PropertyWriter
 {
     virtual ~PropertyWriter() {}
     virtual void open(const string& filename) = 0;
+    virtual void open(const string& filename, const PropertyCompression& compression) = 0;
+    virtual void resume(const string& filename, const PropertyCompression& compression, index_t size) = 0;
+    virtual void open_dense(const string& filename) = 0;
     virtual bool push_back(const boost::any&) = 0;
     virtual bool insert(const boost::any& element, size_t pos) = 0;
+    virtual void serialize(const boost::any& element, std::string& buffer) const = 0;
+    virtual bool push_back_serialized(const std::string& element) = 0;
+};
+
+
+/**
+ * @brief Writes a property file from elements that have already been serialized, independent of their type.
+ *
+ * Does all the work of PropertyWriterT, which adds the serialization of elements of type T. Use it directly to
+ * copy elements between property files without deserializing them, see PropertyCopier.
+ */
+class RawPropertyWriter : boost::noncopyable
+{
+public:
+
+
+    // if you change the internal format, be sure to also adapt the reader
+    static int version()
+    {
+        return 3;
+    }
+
+    RawPropertyWriter() : _dense(false), _rowsize(-1), _position(0), _queue(queue_capacity), _unsynced(0), _failed(false) {}
+
+
+    /**
+     * @brief Open the passed filename for writing, if the file aready exists, its content will be overwritten.
+     * @param map Map stored in the file, must contain the __typeinfo of the elements. The entries describing
+     * the layout of the file are replaced, except for __layout = dense, which selects the dense layout: all
+     * elements must have the same size and be pushed back in order, see PropertyWriterT::open_dense().
+     * @throw std::runtime_error if the file cannot be opened, the codec is not supported by this build or a dense file should be compressed
+     */
+    void open(const string& filename, const PropertyCompression& compression, const strmap_t& map)
+    {
+        if (!PropertyCompression::available(compression.codec)) throw std::runtime_error("compression " + compression.name() + " is not supported by this build");
+        assert(map.count("__typeinfo"));
+
+        strmap_t::const_iterator it = map.find("__layout");
+        _dense = (it != map.end() && it->second == "dense");
+        if (_dense && compression.codec != PropertyCompression::None) throw std::runtime_error("dense property files cannot be compressed");
+
+        _ofs.open(filename.c_str(), std::ofstream::binary|std::ofstream::trunc);
+        if (!_ofs.is_open()) throw std::runtime_error("could not open file " + filename);
+        _compression = compression;
+
+        _map = map;
+        _map.erase("__features");
+        _map.erase("__offsets");
+        _map.erase("__blocks");
+        _map.erase("__compression");
+        _map.erase("__shuffle");
+        _map.erase("__rows");
+        _map.erase("__rowsize");
+
+        // uncompressed files are still written in version 2, such that older readers can read them
+        bool compressed = (_compression.codec != PropertyCompression::None);
+        _map["__version"] = boost::lexical_cast<std::string>((compressed || _dense) ? version() : 2);
+
+        if (compressed)
+        {
+            _map["__compression"] = _compression.name();
+            _map["__shuffle"] = boost::lexical_cast<std::string>(_compression.shuffle);
+        }
+
+        _filename = filename;
+        _journal.open(filename, _map);
+        start();
+    }
+
+    /**
+     * @brief Continues writing a file that has not been completed, e.g. because the program died, or a complete one.
+     *
+     * Keeps the elements [0, size) of the file, the next element pushed back gets index size. Elements written after
+     * the last checkpoint of an incomplete file are lost, use resumable_size() to find out how many elements can be
+     * kept. The data of the elements behind the kept ones is cut off. If the file does not exist, it is created as with
+     * open(). An existing file keeps its compression, only the block size is taken from compression.
+     * @param typeinfo Type of the elements the file must contain
+     * @throw std::runtime_error if the file cannot be opened, contains elements of another type or less than size elements,
+     * or if some of the elements to keep are stored behind the others (which only happens with insert())
+     */
+    void resume(const string& filename, const PropertyCompression& compression, index_t size, const std::string& typeinfo)
+    {
+        PropertyIndex index;
+        if (!read_property_state(filename, index))
+        {
+            if (size > 0) throw std::runtime_error("cannot resume file " + filename + ", it does not exist");
+
+            strmap_t map;
+            map["__typeinfo"] = typeinfo;
+            open(filename, compression, map);
+            return;
+        }
+
+        if (index.map.count("__features") && index.map["__features"] != "0")
+        {
+            throw std::runtime_error("cannot resume file " + filename + ", it has been written by an older version");
+        }
+        if (index.map["__typeinfo"] != typeinfo)
+        {
+            throw std::runtime_error("cannot resume file " + filename + ", it contains elements of type " + index.map["__typeinfo"]);
+        }
+        if (size > index.prefix_size()) throw std::runtime_error("cannot resume file " + filename + ", it contains less elements than requested");
+
+        _map = index.map;
+        _compression = compression;
+        _compression.codec = PropertyCompression::codec_from_name(index.compressed() ? index.map["__compression"] : "none");
+        _compression.shuffle = index.map.count("__shuffle") ? boost::lexical_cast<size_t>(index.map["__shuffle"]) : 0;
+        if (!PropertyCompression::available(_compression.codec)) throw std::runtime_error("compression " + _compression.name() + " is not supported by this build");
+
+        _dense = index.dense();
+        if (_dense)
+        {
+            index_t rows = index.prefix_size();
+            _rowsize = (rows > 0) ? index.rawend / rows : -1;
+        }
+
+        // the kept elements end where the first dropped one starts, the data behind is cut off
+        int64_t cut = index.rawend;
+        for (size_t i = size; i < index.offsets.size(); i++)
+        {
+            if (index.offsets[i] >= 0) cut = std::min(cut, index.offsets[i]);
+        }
+        for (index_t i = 0; i < size; i++)
+        {
+            if (index.offsets[i] >= cut) throw std::runtime_error("cannot resume file " + filename + ", the elements to keep are not stored in front of the others");
+        }
+
+        // the blocks of compressed files are dropped from the one containing the cut,
+        // the kept elements of that block are written again in a new block
+        std::vector<char> kept;
+        if (!index.compressed())
+        {
+            index.dataend = index.rawend = cut;
+        }
+        else if (cut < index.rawend)
+        {
+            size_t b = std::upper_bound(index.blockstart.begin(), index.blockstart.end(), cut) - index.blockstart.begin() - 1;
+            if (cut > index.blockstart[b])
+            {
+                read_block(filename, index, b, kept);
+                kept.resize(cut - index.blockstart[b]);
+            }
+
+            index.dataend = index.blockpos[b];
+            index.rawend = index.blockstart[b];
+            index.blockpos.resize(b);
+            index.blockstart.resize(b);
+        }
+
+        _offset.assign(index.offsets.begin(), index.offsets.begin() + size);
+        _position = index.rawend;
+        _blockpos.swap(index.blockpos);
+        _blockstart.swap(index.blockstart);
+
+        // continue right behind the elements, the index is written again on closing
+        resize_file(filename, index.dataend);
+        _ofs.open(filename.c_str(), std::ofstream::binary|std::ofstream::in|std::ofstream::out);
+        if (!_ofs.is_open()) throw std::runtime_error("could not open file " + filename);
+        _ofs.seekp(index.dataend);
+
+        // the new journal starts with a checkpoint of what is still in the file, the elements
+        // written again are recorded by the checkpoint that follows writing their block
+        std::vector<std::pair<int64_t, int64_t> > entries;
+        for (index_t i = 0; i < size; i++)
+        {
+            if (_offset[i] < index.rawend) entries.push_back(std::make_pair(i, _offset[i]));
+            else _entries.push_back(std::make_pair(i, _offset[i]));
+        }
+
+        _filename = filename;
+        _journal.open(filename, _map);
+        _journal.checkpoint(entries, _blockpos, _blockstart, index.dataend, index.rawend);
+
+        _block.assign(kept.begin(), kept.end());
+        _position += _block.size();
+        _unsynced = _block.empty() ? 0 : checkpoint_size;
+        start();
+        flush_block();
+    }
+
+
+    ~RawPropertyWriter()
+    {
+        if (!_ofs.is_open()) return;
+
+        try { flush_block(); }
+        catch (const std::exception& e) { std::cerr << "PropertyWriterT: " << e.what() << std::endl; }
+
+        // the writer thread writes the remaining blocks and terminates
+        _queue.close();
+        if (_thread.joinable()) _thread.join();
+        if (_failed) std::cerr << "PropertyWriterT: " << _message << std::endl;
+
+        PropertyIndex index;
+        index.map.swap(_map);
+        index.offsets.swap(_offset);
+        index.blockpos.swap(_blockpos);
+        index.blockstart.swap(_blockstart);
+        index.dataend = _ofs.tellp();
+        index.rawend = _position;
+        write_property_index(_ofs, index);
+
+        _ofs.close();
+
+        // keep the journal of a broken file for recovery
+        if (!_failed && _ofs) _journal.remove();
+    }
+
+
+    /// Append a serialized element to the end of the file
+    /// @throw std::runtime_error if writing to the file failed
+    bool push_back_serialized(const char* element, std::size_t size)
+    {
+        assert(_ofs.is_open());
+        if (_dense) check_row(size, _offset.size());
+        _offset.push_back(_position);
+        append(_offset.size() - 1, element, size);
+        return true;
+    }
+
+    /// Insert a serialized element at an arbitrary position in the file
+    /// @throw std::runtime_error if writing to the file failed
+    bool insert_serialized(const char* element, std::size_t size, std::size_t pos)
+    {
+        assert(_ofs.is_open());
+        if (_dense) check_row(size, pos);
+        if (_offset.size() <= pos) _offset.resize(pos + 1, -1);
+        _offset[pos] = _position;
+        append(pos, element, size);
+        return true;
+    }
+
+    /// Number of elements written so far, i.e. the index of the next element pushed back
+    index_t size() const
+    {
+        return _offset.size();
+    }
+
+    /// Whether the file has the dense layout
+    bool dense() const
+    {
+        return _dense;
+    }
+
+
+// Mathias 22.03.2012: seems to be unused, delete at some point
+//    bool insert_map_entry(const std::string& key, const std::string& value)
+//    {
+//        return _map.insert(typename strmap_t::value_type(key, value)).second;
+//    }
+
+private:
+
+    // number of full blocks waiting for the writer thread
+    static const std::size_t queue_capacity = 4;
+
+    // size of the writes to an uncompressed file
+    static const std::size_t write_size = 4 << 20;
+
+    // amount of (uncompressed) data written between two checkpoints
+    static const int64_t checkpoint_size = 64 << 20;
+
+    typedef std::vector<std::pair<int64_t, int64_t> > entries_t;
+
+    // the serialized elements and their indices and offsets
+    struct block_t
+    {
+        int64_t     start;
+        std::string data;
+        entries_t   entries;
+    };
+
+    // rows of dense files must all have the size of the first one and be written in order
+    void check_row(std::size_t size, std::size_t pos)
+    {
+        if (pos != _offset.size()) throw std::runtime_error("rows of a dense property file must be written in order");
+        if (_rowsize < 0) _rowsize = size;
+        if (static_cast<int64_t>(size) != _rowsize) throw std::runtime_error("rows of a dense property file must all have the same size");
+    }
+
+    // Decompressed data of block b of a file that is not open yet
+    void read_block(const string& filename, const PropertyIndex& index, size_t b, std::vector<char>& data) const
+    {
+        int64_t end = (b + 1 < index.blockpos.size()) ? index.blockpos[b + 1] : index.dataend;
+        int64_t rawend = (b + 1 < index.blockstart.size()) ? index.blockstart[b + 1] : index.rawend;
+
+        std::vector<char> compressed(end - index.blockpos[b]);
+        std::ifstream is(filename.c_str(), std::ifstream::binary);
+        is.seekg(index.blockpos[b]);
+        if (!compressed.empty()) is.read(&compressed[0], compressed.size());
+        if (!is.good()) throw std::runtime_error("error while reading file " + filename);
+
+        data.resize(rawend - index.blockstart[b]);
+        io::decompress_block(_compression, compressed.empty() ? 0 : &compressed[0], compressed.size(), data);
+    }
+
+    void start()
+    {
+        _block.reserve(block_size());
+        _thread = boost::thread(boost::bind(&RawPropertyWriter::write_blocks, this));
+    }
+
+    std::size_t block_size() const
+    {
+        return (_compression.codec == PropertyCompression::None) ? write_size : _compression.blocksize;
+    }
+
+    // elements never span blocks, a block is handed over after the element that fills it
+    void append(index_t index, const char* element, std::size_t size)
+    {
+        _entries.push_back(std::make_pair(index, _position));
+        _block.append(element, size);
+        _position += size;
+        if (_block.size() >= block_size()) flush_block();
+    }
+
+    void flush_block()
+    {
+        if (_block.empty()) return;
+
+        boost::shared_ptr<block_t> block = boost::make_shared<block_t>();
+        block->start = _position - static_cast<int64_t>(_block.size());
+        block->data.swap(_block);
+        block->entries.swap(_entries);
+        _block.reserve(block_size());
+
+        if (!_queue.push(block))
+        {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            throw std::runtime_error(_message);
+        }
+    }
+
+    // Executed by the writer thread, the only one accessing _ofs and the block index while the file is open
+    void write_blocks()
+    {
+        boost::shared_ptr<block_t> block;
+        while (_queue.pop(block))
+        {
+            try { write_block(*block); }
+            catch (const std::exception& e)
+            {
+                {
+                    boost::lock_guard<boost::mutex> lock(_mutex);
+                    _message = e.what();
+                    _failed = true;
+                }
+                _queue.close();
+                return;
+            }
+        }
+    }
+
+    void write_block(const block_t& block)
+    {
+        int64_t begin = _ofs.tellp();
+        if (_compression.codec == PropertyCompression::None)
+        {
+            _ofs.write(block.data.data(), block.data.size());
+        }
+        else
+        {
+            std::vector<char> compressed;
+            io::compress_block(_compression, block.data.data(), block.data.size(), compressed);
+
+            _blockpos.push_back(begin);
+            _blockstart.push_back(block.start);
+            _pendingblockpos.push_back(begin);
+            _pendingblockstart.push_back(block.start);
+            _ofs.write(&compressed[0], compressed.size());
+        }
+
+        if (!_ofs.good()) throw std::runtime_error("error while writing property file");
+
+        _pendingentries.insert(_pendingentries.end(), block.entries.begin(), block.entries.end());
+        _unsynced += block.data.size();
+        if (_unsynced >= checkpoint_size) checkpoint(block.start + block.data.size());
+    }
+
+    // Syncs the data written so far to disk, only then records it in the journal
+    void checkpoint(int64_t rawend)
+    {
+        _ofs.flush();
+        if (!_ofs.good()) throw std::runtime_error("error while writing property file");
+        PropertyJournal::sync_file(_filename);
+
+        _journal.checkpoint(_pendingentries, _pendingblockpos, _pendingblockstart, _ofs.tellp(), rawend);
+        _pendingentries.clear();
+        _pendingblockpos.clear();
+        _pendingblockstart.clear();
+        _unsynced = 0;
+    }
+
+    std::ofstream        _ofs;
+    std::vector<int64_t> _offset;
+    strmap_t             _map;
+    PropertyCompression  _compression;
+
+    // dense layout and size of its rows, -1 until the first row has been written
+    bool    _dense;
+    int64_t _rowsize;
+
+    // the block currently being filled with the indices and offsets of its elements
+    // and the position of the next element in the (uncompressed) data
+    std::string _block;
+    entries_t   _entries;
+    int64_t     _position;
+
+    // full blocks are passed to the writer thread, which also fills the block index of compressed files
+    BoundedQueue<boost::shared_ptr<block_t> > _queue;
+    boost::thread                             _thread;
+    std::vector<int64_t>                      _blockpos;
+    std::vector<int64_t>                      _blockstart;
+
+    // the journal and, owned by the writer thread, what has been written since the last checkpoint
+    std::string          _filename;
+    PropertyJournal      _journal;
+    entries_t            _pendingentries;
+    std::vector<int64_t> _pendingblockpos;
+    std::vector<int64_t> _pendingblockstart;
+    int64_t              _unsynced;
+
+    // set by the writer thread in case writing fails
+    bool         _failed;
+    std::string  _message;
+    boost::mutex _mutex;
 };
 
 
@@ -49,13 +512,27 @@ struct PropertyWriter
  * free harddisk space. We have sucessfully generated files close to a Terabyte in size. The files are
  * directly portable between 64-bit and 32-bit machines but not portable between machines of differing endianness.
  *
+ * Optionally, the elements can be stored in compressed blocks, see PropertyCompression. Such files use version 3
+ * of the format: the offsets table refers to positions in the uncompressed data and a block index maps these to
+ * the compressed blocks. Uncompressed files are still written in version 2.
+ *
+ * Elements are serialized into a memory buffer, their offsets follow from the sizes of the previous elements.
+ * Full buffers of several megabytes are handed to a writer thread that (compresses and) writes them to disk,
+ * such that pushing elements hardly ever waits for the disk. Elements can also be serialized by the caller with
+ * serialize(), e.g. in parallel by several threads, and then be appended with push_back_serialized(). Errors of
+ * the writer thread are reported by the next push_back() that hands over a buffer.
+ *
+ * The index of the file is only written when the writer is destroyed. Until then, the writer thread regularly
+ * syncs the data to disk and records a checkpoint in a PropertyJournal next to the file. If the program dies, the
+ * file can be made readable up to the last checkpoint with recover_property() or be continued with resume().
+ *
  * Use PropertyReaderT to read in a property file that has been written with PropertyWriterT.
  *
  * Note: instances are noncopyable since they internally open files.
  *
  */
 template <class T>
-class PropertyWriterT : public PropertyWriter, boost::noncopyable
+class PropertyWriterT : public PropertyWriter, public RawPropertyWriter
 {
 public:
 
@@ -63,84 +540,101 @@ public:
     // if you change the internal format, be sure to also adapt the reader
     static int version()
     {
-        return 2;
+        return RawPropertyWriter::version();
     }
 
     PropertyWriterT() {}
 
     /// Open the passed filename for writing, if the file aready exists, its content will be overwritten
-    PropertyWriterT(const string& filename)
+    PropertyWriterT(const string& filename, const PropertyCompression& compression = PropertyCompression())
     {
-        this->open(filename);
+        this->open(filename, compression);
     }
 
     /// Open the passed filename for writing, if the file aready exists, its content will be overwritten
     void open(const string& filename)
     {
-        _ofs.open(filename.c_str(), std::ofstream::binary|std::ofstream::trunc);
-        if (!_ofs.is_open()) throw std::runtime_error("could not open file " + filename);
-        _map["__version"] = boost::lexical_cast<std::string>(version());
-        string type_name = imdb::nameof<T>();
-        _map["__typeinfo"] = type_name;
+        open(filename, PropertyCompression());
     }
 
-
-    ~PropertyWriterT()
+    /// Open the passed filename for writing compressed blocks of elements, if the file aready exists, its content will be overwritten
+    /// @throw std::runtime_error if the file cannot be opened or the codec is not supported by this build
+    void open(const string& filename, const PropertyCompression& compression)
     {
-        if (!_ofs.is_open()) return;
-
-        int64_t p_features = 0;
-        _map["__features"] = boost::lexical_cast<std::string>(p_features);
-
-        int64_t p_offsets = _ofs.tellp();
-        _map["__offsets"] = boost::lexical_cast<std::string>(p_offsets);
-        io::write(_ofs, _offset);
+        strmap_t map;
+        map["__typeinfo"] = imdb::nameof<T>();
+        RawPropertyWriter::open(filename, compression, map);
+    }
 
-        int64_t p_map = _ofs.tellp();
-        io::write(_ofs, _map);
-        io::write(_ofs, p_map);
+    /**
+     * @brief Open the passed filename for writing a dense file, if the file aready exists, its content will be overwritten.
+     *
+     * For T = vector<A> of an arithmetic type A, e.g. the vec_f32_t of a global descriptor, whose elements all have
+     * the same size. Such a file is an n x d matrix: the rows follow each other without their size and without an
+     * offsets table, the values of each row are aligned. It can be read at once with read_dense_property() or be
+     * memory-mapped with MappedPropertyReaderT, other than the regular layout, that needs an allocation per row.
+     * Rows must be pushed back in order, pushing back a row of a different size throws. Dense files cannot be
+     * compressed, use version 3 of the format and are read like any other property file.
+     *
+     * For all other element types, opens a regular file as open().
+     * @throw std::runtime_error if the file cannot be opened
+     */
+    void open_dense(const string& filename)
+    {
+        strmap_t map;
+        map["__typeinfo"] = imdb::nameof<T>();
+        if (io::is_dense_row<T>::value) map["__layout"] = "dense";
+        RawPropertyWriter::open(filename, PropertyCompression(), map);
+    }
 
-        _ofs.close();
+    /// Continues writing a file behind its first size elements, see RawPropertyWriter::resume()
+    /// @throw std::runtime_error if the file cannot be opened, contains elements of another type or less than size elements
+    void resume(const string& filename, const PropertyCompression& compression, index_t size)
+    {
+        RawPropertyWriter::resume(filename, compression, size, imdb::nameof<T>());
     }
 
 
     /// Append an element to the end of the file
+    /// @throw std::runtime_error if writing to the file failed
     bool push_back(const boost::any& element)
     {
-        assert(_ofs.is_open());
-        _offset.push_back(_ofs.tellp());
-        io::write(_ofs, boost::any_cast<T>(element));
-        assert(_ofs.good());
-        return true;
+        serialize(element, _element);
+        return push_back_serialized(_element);
     }
 
     /// Insert an element at an arbitrary position in the file
+    /// @throw std::runtime_error if writing to the file failed
     bool insert(const boost::any& element, size_t pos)
     {
-        assert(_ofs.is_open());
-        if (_offset.size() <= pos) _offset.resize(pos + 1, -1);
-        _offset[pos] = _ofs.tellp();
-        io::write(_ofs, boost::any_cast<T>(element));
-        assert(_ofs.good());
-        return true;
+        serialize(element, _element);
+        return insert_serialized(_element.data(), _element.size(), pos);
     }
 
+    /// Serializes element into buffer, replacing its content. Does not touch the file, i.e. may be called concurrently.
+    void serialize(const boost::any& element, std::string& buffer) const
+    {
+        buffer.clear();
+        boost::iostreams::stream<boost::iostreams::back_insert_device<std::string> > os(buffer);
+        if (dense()) detail::write_dense(os, boost::any_cast<const T&>(element));
+        else io::write(os, boost::any_cast<const T&>(element));
+        os.flush();
+    }
 
-// Mathias 22.03.2012: seems to be unused, delete at some point
-//    bool insert_map_entry(const std::string& key, const std::string& value)
-//    {
-//        return _map.insert(typename strmap_t::value_type(key, value)).second;
-//    }
+    /// Append an element that has been serialized with serialize() to the end of the file
+    /// @throw std::runtime_error if writing to the file failed
+    bool push_back_serialized(const std::string& element)
+    {
+        return RawPropertyWriter::push_back_serialized(element.data(), element.size());
+    }
 
 private:
 
-    std::ofstream        _ofs;
-    std::vector<int64_t> _offset;
-    strmap_t             _map;
+    // buffer for serializing single elements
+    std::string _element;
 };
 
 
-
 /**
  * @brief Convenience function for getting a boost::shared_ptr to a PropertyWriter for elements of type T.
  *
@@ -148,10 +642,10 @@ private:
  * content in case the file already exists, otherwise it will be created.
  */
 template <class T>
-boost::shared_ptr<PropertyWriter> create_writer(const std::string& filename)
+boost::shared_ptr<PropertyWriter> create_writer(const std::string& filename, const PropertyCompression& compression = PropertyCompression())
 {
     PropertyWriterT<T>* pw = new PropertyWriterT<T>();
-    pw->open(filename);
+    pw->open(filename, compression);
     return boost::shared_ptr<PropertyWriter>(pw);
 }
 
@@ -162,10 +656,10 @@ boost::shared_ptr<PropertyWriter> create_writer(const std::string& filename)
  * the file already exists, otherwise it will be created.
  */
 template <class T>
-void write_property(const std::vector<T>& v, const std::string& filename)
+void write_property(const std::vector<T>& v, const std::string& filename, const PropertyCompression& compression = PropertyCompression())
 {
     PropertyWriterT<T> wr;
-    wr.open(filename);
+    wr.open(filename, compression);
     for (size_t i = 0; i < v.size(); i++) wr.push_back(v[i]);
 }
 
@@ -38,4 +38,9 @@ void BofSearchManager::query(const vec_f32_t& histvw, size_t num_results, vector
     _index.query(histvw, *_tf, *_idf, num_results, results);
 }
 
+void BofSearchManager::query(const vec_f32_t& histvw, size_t num_results, vector<dist_idx_f32_t>& results) const
+{
+    _index.query(histvw, *_tf, *_idf, num_results, results);
+}
+
 } // end namespace imdb
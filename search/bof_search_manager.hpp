@@ -53,6 +53,9 @@ namespace imdb {
          */
         void query(const vec_f32_t& histvw, size_t num_results, vector<dist_idx_t>& results) const;
 
+        /// Same as above but returns the results in the compact dist_idx_f32_t representation
+        void query(const vec_f32_t& histvw, size_t num_results, vector<dist_idx_f32_t>& results) const;
+
         const InvertedIndex& index() const {return _index;}
 
     private:
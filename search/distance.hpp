@@ -217,7 +217,6 @@ struct dist_frobenius
 
         size_t numCells = a.size() / 3;
         assert(mask->size() == numCells);
-        size_t index = 0;
         R dist = 0;
 
         for (size_t i = 0; i < numCells; i++)
@@ -227,7 +226,9 @@ struct dist_frobenius
             // no lines, we ignore it in the distance computation
             if ((*mask)[i]) continue;
 
-            // difference tensor
+            // difference tensor, cell i starts at 3*i independently
+            // of how many cells have been masked out before
+            size_t index = 3*i;
             R dE = a[index] - b[index]; index++;
             R dF = a[index] - b[index]; index++;
             R dG = a[index] - b[index]; index++;
@@ -14,12 +14,25 @@ the terms of the BSD license (see the LICENSE file).
 #include <cassert>
 #include <set>
 #include <utility>
-#include <queue>
+
+#include "top_k.hpp"
 
 
 namespace imdb {
 
 
+namespace
+{
+
+// Index files starting with this tag store the lists as ragged arrays (see io::write_ragged) and
+// are followed by the version of the format. Files without the tag start with the number of words
+// instead, which is never this large, and store the lists as nested vectors.
+const uint32_t format_tag = 0xffffffff;
+const uint32_t format_version = 2;
+
+} // anonymous namespace
+
+
 InvertedIndex::InvertedIndex()
 {
     init();
@@ -152,6 +165,14 @@ void InvertedIndex::apply_tfidf(const InvertedIndex& collection_index, const tf_
 
 
 void InvertedIndex::query(const vec_f32_t& histogram, const tf_function &tf, const idf_function &idf, uint numResults, vector<dist_idx_t>& result) const
+{
+    vector<dist_idx_f32_t> compact;
+    query(histogram, tf, idf, numResults, compact);
+    to_dist_idx(compact, result);
+}
+
+
+void InvertedIndex::query(const vec_f32_t& histogram, const tf_function &tf, const idf_function &idf, uint numResults, vector<dist_idx_f32_t>& result) const
 {
     using namespace std;
 
@@ -159,13 +180,12 @@ void InvertedIndex::query(const vec_f32_t& histogram, const tf_function &tf, con
     numResults = std::min(numResults, _numDocuments);
 
 
-    // Clear the vector and resize it exactly to the required size
-    // so we do not experience multiple automatic vector-internal resizing steps.
-    // Both operations should be extremely cheap if the vector
-    // already has the correct size, i.e. when we re-use a vector from a
+    // Clear the vector, the selection below sizes it exactly as
+    // required. This should be extremely cheap if the vector
+    // already has the correct capacity, i.e. when we re-use a vector from a
     // prvious query.
     result.clear();
-    result.reserve(numResults);
+    if (_numDocuments == 0) return;
 
 
 
@@ -209,30 +229,9 @@ void InvertedIndex::query(const vec_f32_t& histogram, const tf_function &tf, con
     }
 
 
-    // we use a priority_queue with std::greater as the comparator,
-    // this means, that only elements will get added with a push()
-    // that are greater than the currently smallest element in the queue,
-    // i.e. the queue retains the largest entries from the accumulator with
-    // the smallest element in the queue sorted on top of the queue
-    std::priority_queue<dist_idx_t, std::vector<dist_idx_t>, std::greater<dist_idx_t> > queue;
-
-    for (uint i = 0; i < _numDocuments; i++)
-    {
-        queue.push(dist_idx_t(accumulators[i], i));
-        if (queue.size() > numResults) queue.pop();
-    }
-    assert(queue.size() <= numResults);
-
-    // DO NOT CHANGE the limit to queue.size() in the loop,
-    // since queue becomes smaller each iteration!
-    for (uint i = 0; i < numResults; i++)
-    {
-        result.push_back(queue.top());
-        queue.pop();
-    }
-
-    // need to reverse, since the smallest element out of the queue is sorted on top
-    std::reverse(result.begin(), result.end());
+    // select the numResults documents with the largest dot product, the
+    // results come back sorted by descending similarity
+    select_k_largest(&accumulators[0], _numDocuments, numResults, result);
 }
 
 
@@ -306,6 +305,8 @@ std::ofstream& operator<<(std::ofstream& stream, const InvertedIndex& index) {
 
     assert(index._finalized);
 
+    io::write(stream, format_tag);
+    io::write(stream, format_version);
     io::write(stream, index._numWords);
     io::write(stream, index._numDocuments);
     io::write(stream, index._avgDocLen);
@@ -313,8 +314,8 @@ std::ofstream& operator<<(std::ofstream& stream, const InvertedIndex& index) {
     io::write(stream, index._Ft);
     io::write(stream, index._uniqueWords);
     io::write(stream, index._ft);
-    io::write(stream, index._docFrequencyList);
-    io::write(stream, index._docWeightList);
+    io::write_ragged(stream, index._docFrequencyList);
+    io::write_ragged(stream, index._docWeightList);
     io::write(stream, index._documentSizes);
     io::write(stream, index._documentUniqueSizes);
     return stream;
@@ -323,15 +324,39 @@ std::ofstream& operator<<(std::ofstream& stream, const InvertedIndex& index) {
 
 std::ifstream& operator>>(std::ifstream& stream, InvertedIndex& index) {
     index.init();
-    io::read(stream, index._numWords);
+
+    uint32_t tag;
+    io::read(stream, tag);
+
+    bool ragged = (tag == format_tag);
+    if (ragged)
+    {
+        uint32_t version;
+        io::read(stream, version);
+        if (version != format_version) throw std::ios_base::failure("unsupported version of inverted index file");
+        io::read(stream, index._numWords);
+    }
+    else
+    {
+        index._numWords = tag;
+    }
+
     io::read(stream, index._numDocuments);
     io::read(stream, index._avgDocLen);
     io::read(stream, index._avgUniqueDocLen);
     io::read(stream, index._Ft);
     io::read(stream, index._uniqueWords);
     io::read(stream, index._ft);
-    io::read(stream, index._docFrequencyList);
-    io::read(stream, index._docWeightList);
+    if (ragged)
+    {
+        io::read_ragged(stream, index._docFrequencyList);
+        io::read_ragged(stream, index._docWeightList);
+    }
+    else
+    {
+        io::read(stream, index._docFrequencyList);
+        io::read(stream, index._docWeightList);
+    }
     io::read(stream, index._documentSizes);
     io::read(stream, index._documentUniqueSizes);
     index._finalized = true;
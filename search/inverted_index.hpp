@@ -114,6 +114,9 @@ public:
      */
     void query(const vec_f32_t& histogram, const tf_function &tf, const idf_function &idf, uint numResults, vector<dist_idx_t>& result) const;
 
+    /// Same as above but returns the results in the compact dist_idx_f32_t representation as used internally
+    void query(const vec_f32_t& histogram, const tf_function &tf, const idf_function &idf, uint numResults, vector<dist_idx_f32_t>& result) const;
+
 
     inline const vector<vector<doc_freq_pair> >& doc_frequency_list() const {return _docFrequencyList;}
     inline const vector<vector<float> >&            doc_weight_list()    const {return _docWeightList;}
@@ -30,40 +30,57 @@ the terms of the BSD license (see the LICENSE file).
  *
  * The result is always a container class containing at each index
  * a std::pair(distance, index), where index points into the features
- * collection.
+ * collection. Internally, distances are handled as float and indices as
+ * 32-bit integers (dist_idx_f32_t), so features may contain at most 2^32 elements.
  */
 template <class storage_t, class result_t, class distfn_t>
 void linear_search(const typename storage_t::value_type& query_feature, const storage_t& features, result_t& result, size_t num_results, const distfn_t& distfn)
 {
 
+    using namespace imdb;
     using namespace std;
 
+    // the heap is kept in the compact (float, uint32) representation, we
+    // only convert to the element type of result once we are done
+    vector<dist_idx_f32_t> heap;
+    heap.reserve(min(num_results, result.size() + features.size()));
+
     // if result is not empty, then its content get involved by the search algorithm
     // i.e. result will be updated
-    if (result.size() > 0) make_heap(result.begin(), result.end());
+    for (typename result_t::const_iterator it = result.begin(); it != result.end(); ++it)
+    {
+        heap.push_back(dist_idx_f32_t(it->first, it->second));
+    }
+    if (heap.size() > 0) make_heap(heap.begin(), heap.end());
 
     for (size_t i = 0; i < features.size(); i++)
     {
-        typename distfn_t::result_type dist = distfn(query_feature, features[i]);
+        float dist = distfn(query_feature, features[i]);
 
         // if the number of wanted elements is not reached, every element is taken
         // else if the current element has smaller distance than the element with
         // the greatest distance in the queue, then it is inserted into the queue
-        if (result.size() < num_results)
+        if (heap.size() < num_results)
         {
-            result.push_back(make_pair(dist, i));
-            push_heap(result.begin(), result.end());
+            heap.push_back(dist_idx_f32_t(dist, i));
+            push_heap(heap.begin(), heap.end());
         }
-        else if (!result.empty() && result.front().first > dist)
+        else if (!heap.empty() && heap.front().first > dist)
         {
-            pop_heap(result.begin(), result.end());
-            result.back() = make_pair(dist, i);
-            push_heap(result.begin(), result.end());
+            pop_heap(heap.begin(), heap.end());
+            heap.back() = dist_idx_f32_t(dist, i);
+            push_heap(heap.begin(), heap.end());
         }
     }
 
     // make an ascending sorted list out of the heap
-    sort_heap(result.begin(), result.end());
+    sort_heap(heap.begin(), heap.end());
+
+    result.clear();
+    for (size_t i = 0; i < heap.size(); i++)
+    {
+        result.push_back(typename result_t::value_type(heap[i].first, heap[i].second));
+    }
 }
 
 #endif // SEARCH_HPP
@@ -9,7 +9,7 @@ the terms of the BSD license (see the LICENSE file).
 #include <algorithm>
 
 #include "linear_search_manager.hpp"
-#include "linear_search.hpp"
+#include "top_k.hpp"
 #include "../io/property_reader.hpp"
 
 namespace imdb
@@ -36,8 +36,21 @@ LinearSearchManager::LinearSearchManager(const ptree& parameters)
 
 void LinearSearchManager::query(const vec_f32_t& descr, size_t num_results, vector<dist_idx_t>& result) const
 {
-    size_t max_num_results = std::min(num_results, _features.size());
-    linear_search(descr, _features, result, max_num_results, _distfn);
+    vector<dist_idx_f32_t> compact;
+    query(descr, num_results, compact);
+    to_dist_idx(compact, result);
+}
+
+void LinearSearchManager::query(const vec_f32_t& descr, size_t num_results, vector<dist_idx_f32_t>& result) const
+{
+    result.clear();
+    if (_features.empty()) return;
+
+    // compute all distances first, then select the best ones
+    vec_f32_t dists(_features.size());
+    for (size_t i = 0; i < _features.size(); i++) dists[i] = _distfn(descr, _features[i]);
+
+    select_k_smallest(&dists[0], dists.size(), num_results, result);
 }
 
 } // namespace imdb
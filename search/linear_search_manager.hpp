@@ -54,6 +54,9 @@ class LinearSearchManager
      * in the property file that has been searched.
      */
     void query(const vec_f32_t& data, size_t num_results, vector<dist_idx_t>& result) const;
+
+    /// Same as above but returns the results in the compact dist_idx_f32_t representation
+    void query(const vec_f32_t& data, size_t num_results, vector<dist_idx_f32_t>& result) const;
     const vec_vec_f32_t& features() {return _features;}
 
     private:
@@ -0,0 +1,174 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tensor_search_manager.hpp"
+#include "top_k.hpp"
+#include "../io/property_reader.hpp"
+
+namespace imdb
+{
+
+namespace
+{
+
+// Masked Frobenius distance between the query and a single feature f. The query
+// has already been reduced to its active cells and is stored as three separate arrays
+// (E, F and G entry of each cell's tensor), active[i] is the offset of the i-th active
+// cell into the feature. Computes the same value as dist_frobenius up to floating-point
+// rounding, the SSE path sums the cells in a different order.
+inline float masked_frobenius(const float* qE, const float* qF, const float* qG, const uint32_t* active, size_t numActive, const float* f)
+{
+    size_t i = 0;
+    float dist = 0;
+
+#ifdef __SSE2__
+    // four cells at a time, the gather from the feature is done using scalar
+    // loads, all arithmetic including the (expensive) sqrt is done in SSE
+    __m128 acc = _mm_setzero_ps();
+    const __m128 two = _mm_set1_ps(2.0f);
+    for (; i + 4 <= numActive; i += 4)
+    {
+        const float* f0 = f + active[i];
+        const float* f1 = f + active[i+1];
+        const float* f2 = f + active[i+2];
+        const float* f3 = f + active[i+3];
+
+        __m128 dE = _mm_sub_ps(_mm_loadu_ps(qE + i), _mm_setr_ps(f0[0], f1[0], f2[0], f3[0]));
+        __m128 dF = _mm_sub_ps(_mm_loadu_ps(qF + i), _mm_setr_ps(f0[1], f1[1], f2[1], f3[1]));
+        __m128 dG = _mm_sub_ps(_mm_loadu_ps(qG + i), _mm_setr_ps(f0[2], f1[2], f2[2], f3[2]));
+
+        __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dE, dE), _mm_mul_ps(two, _mm_mul_ps(dF, dF))), _mm_mul_ps(dG, dG));
+        acc = _mm_add_ps(acc, _mm_sqrt_ps(n));
+    }
+
+    float partial[4];
+    _mm_storeu_ps(partial, acc);
+    dist = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+
+    // remaining cells (or all of them if SSE is not available)
+    for (; i < numActive; i++)
+    {
+        const float* fc = f + active[i];
+        float dE = qE[i] - fc[0];
+        float dF = qF[i] - fc[1];
+        float dG = qG[i] - fc[2];
+        dist += std::sqrt(dE*dE + 2*dF*dF + dG*dG);
+    }
+
+    return dist;
+}
+
+} // anonymous namespace
+
+
+TensorSearchManager::TensorSearchManager(const ptree& parameters)
+    : _numFeatures(0)
+    , _dim(0)
+{
+    string filename = parameters.get<string>("descriptor_file");
+
+    // try to load features, we directly copy them into a single contiguous
+    // block of memory instead of keeping a vector<vector<float> > around
+    try {
+        PropertyReaderT<vec_f32_t> reader(filename);
+
+        vec_f32_t feature;
+        for (index_t i = 0; i < reader.size(); i++)
+        {
+            reader.get(feature, i);
+
+            if (i == 0)
+            {
+                _dim = feature.size();
+                if (_dim % 3 != 0) throw std::runtime_error("size of tensor features must be a multiple of 3");
+                _features.reserve(reader.size() * _dim);
+            }
+            else if (feature.size() != _dim)
+            {
+                throw std::runtime_error("all tensor features must have the same size");
+            }
+
+            _features.insert(_features.end(), feature.begin(), feature.end());
+            _numFeatures++;
+        }
+    } catch(std::exception& e) {
+        std::cerr << "TensorSearchManager: exception occured when trying to load features file: " + filename << std::endl;
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+
+void TensorSearchManager::compile_mask(const vector<bool>& mask, vec_u32_t& active)
+{
+    active.clear();
+    for (size_t i = 0; i < mask.size(); i++)
+    {
+        if (!mask[i]) active.push_back(static_cast<uint32_t>(3*i));
+    }
+}
+
+
+void TensorSearchManager::query(const vec_f32_t& descr, const vector<bool>& mask, size_t num_results, vector<dist_idx_t>& result) const
+{
+    vector<dist_idx_f32_t> compact;
+    query(descr, mask, num_results, compact);
+    to_dist_idx(compact, result);
+}
+
+
+void TensorSearchManager::query(const vec_f32_t& descr, const vector<bool>& mask, size_t num_results, vector<dist_idx_f32_t>& result) const
+{
+    using namespace std;
+
+    result.clear();
+    if (_numFeatures == 0) return;
+
+    assert(descr.size() == _dim);
+    assert(mask.size() == _dim / 3);
+
+    vec_u32_t active;
+    compile_mask(mask, active);
+
+    // split the query into E, F and G arrays over the active cells
+    // only, this makes the query side of the kernel contiguous
+    size_t numActive = active.size();
+    vec_f32_t qE(numActive + 1), qF(numActive + 1), qG(numActive + 1);
+    for (size_t i = 0; i < numActive; i++)
+    {
+        qE[i] = descr[active[i]];
+        qF[i] = descr[active[i] + 1];
+        qG[i] = descr[active[i] + 2];
+    }
+
+    // compute distances to all features in parallel, empty
+    // features (and queries) have distance 0 to each other
+    vec_f32_t dists(_numFeatures, 0.0f);
+    const uint32_t* pa = numActive ? &active[0] : 0;
+
+    if (_dim > 0)
+    {
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < static_cast<long>(_numFeatures); i++)
+        {
+            dists[i] = masked_frobenius(&qE[0], &qF[0], &qG[0], pa, numActive, &_features[i*_dim]);
+        }
+    }
+
+    select_k_smallest(&dists[0], _numFeatures, num_results, result);
+}
+
+} // namespace imdb
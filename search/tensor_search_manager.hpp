@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef TENSOR_SEARCH_MANAGER_HPP
+#define TENSOR_SEARCH_MANAGER_HPP
+
+#include "../util/types.hpp"
+
+namespace imdb
+{
+
+/**
+ * @ingroup search
+ * @brief Linear search over Tensor descriptors using the masked Frobenius distance.
+ *
+ * Computes the same distances as dist_frobenius up to floating-point rounding (the SSE kernel sums in a different
+ * order) but is organized for speed: all features
+ * are loaded once into a single contiguous block of memory, the query mask is compiled into the list
+ * of active (i.e. not masked out) cells such that the cost of a query is proportional to the number of
+ * active cells only, and the distances to all features are computed in parallel.
+ * Note that this class loads \b all features into main memory, make sure that you have enough memory to do so.
+ */
+class TensorSearchManager
+{
+    public:
+
+    typedef vec_f32_t descr_t;
+
+    /**
+     * @brief Constructs the TensorSearchManager, loads all required datastructures such that a query() can be performed.
+     * @param parameters boost::property_tree that must contain the following key/value pair:
+     * - "descriptor_file": filename of the Tensor features file, e.g. "/tmp/tensor.features". The features file must
+     * have been created using a PropertyWriterT with T=vec_f32_t and all features must have the same size.
+     */
+    TensorSearchManager(const ptree& parameters);
+
+    /**
+     * @brief Perform a linear search using the masked Frobenius distance.
+     *
+     * @param descr Query Tensor descriptor, must have the same size as the features in the property file
+     * @param mask Contains a boolean for each grid cell of the Tensor descriptor, mask[i] = true indicates
+     * that cell i is masked out and ignored when computing the distance (see dist_frobenius).
+     * @param num_results Number of results to be returned
+     * @param result A vector of imdb::dist_idx_t that holds the result indices in descending order of
+     * similarity (i.e. best matches are first in the vector). Any potentially existing contents
+     * of this vector are cleared before the new results are added.
+     */
+    void query(const vec_f32_t& descr, const vector<bool>& mask, size_t num_results, vector<dist_idx_t>& result) const;
+
+    /// Same as above but returns the results in the compact dist_idx_f32_t representation
+    void query(const vec_f32_t& descr, const vector<bool>& mask, size_t num_results, vector<dist_idx_f32_t>& result) const;
+
+    /// Number of features loaded
+    size_t size() const { return _numFeatures; }
+
+    private:
+
+    // Generates the list of all cells that are not masked out. We store
+    // the offset of each cell into the descriptor (i.e. 3*cell index) such
+    // that the kernel does not need to recompute it for every feature
+    static void compile_mask(const vector<bool>& mask, vec_u32_t& active);
+
+    // all features stored one after the other, feature i
+    // starts at _features[i*_dim]
+    vec_f32_t _features;
+    size_t    _numFeatures;
+    size_t    _dim;
+};
+
+} // namespace imdb
+
+#endif // TENSOR_SEARCH_MANAGER_HPP
@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "top_k.hpp"
+
+namespace imdb
+{
+
+namespace
+{
+
+// Ordering of candidates: a comes before b if it has the better score, ties
+// are broken by the smaller index. Used as the 'less' of all heap/sort operations,
+// i.e. the top of a heap is always the worst candidate retained so far.
+struct better_smaller
+{
+    static bool passes(float score, float threshold) { return score < threshold; }
+
+    bool operator()(const dist_idx_f32_t& a, const dist_idx_f32_t& b) const
+    {
+        return (a.first < b.first) || (a.first == b.first && a.second < b.second);
+    }
+
+#ifdef __SSE2__
+    static int passes4(__m128 scores, __m128 threshold) { return _mm_movemask_ps(_mm_cmplt_ps(scores, threshold)); }
+#endif
+};
+
+struct better_larger
+{
+    static bool passes(float score, float threshold) { return score > threshold; }
+
+    bool operator()(const dist_idx_f32_t& a, const dist_idx_f32_t& b) const
+    {
+        return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+    }
+
+#ifdef __SSE2__
+    static int passes4(__m128 scores, __m128 threshold) { return _mm_movemask_ps(_mm_cmpgt_ps(scores, threshold)); }
+#endif
+};
+
+
+// For k close to n a heap does not pay off: nearly every element ends up in the heap anyway.
+// We then simply create all candidates and partition them around the k-th element.
+template <class better_t>
+void select_nth_element(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result)
+{
+    result.resize(n);
+    for (size_t i = 0; i < n; i++) result[i] = dist_idx_f32_t(scores[i], static_cast<uint32_t>(i));
+
+    better_t better;
+    if (k < n) std::nth_element(result.begin(), result.begin() + k, result.end(), better);
+    result.resize(k);
+    std::sort(result.begin(), result.end(), better);
+}
+
+
+// Replace the worst candidate on top of the heap if scores[i] is better
+template <class better_t>
+inline void heap_offer(vector<dist_idx_f32_t>& heap, const float* scores, size_t i, const better_t& better)
+{
+    dist_idx_f32_t c(scores[i], static_cast<uint32_t>(i));
+    if (better(c, heap.front()))
+    {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = c;
+        std::push_heap(heap.begin(), heap.end(), better);
+    }
+}
+
+
+template <class better_t>
+void select_heap(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result)
+{
+    better_t better;
+
+    // initialize the heap with the first k elements
+    result.resize(k);
+    for (size_t i = 0; i < k; i++) result[i] = dist_idx_f32_t(scores[i], static_cast<uint32_t>(i));
+    std::make_heap(result.begin(), result.end(), better);
+
+    // Since we scan with increasing index, a score equal to the threshold can never
+    // replace the top of the heap (it would have the larger index). Thus it is sufficient
+    // to test for scores strictly better than the threshold.
+    size_t i = k;
+
+#ifdef __SSE2__
+    // filter four scores at once against the current threshold, only
+    // if at least one of them passes we need to touch the heap
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 threshold = _mm_set1_ps(result.front().first);
+        int mask = better_t::passes4(_mm_loadu_ps(scores + i), threshold);
+        if (!mask) continue;
+
+        // the threshold may have improved after each insertion, heap_offer checks again
+        for (int l = 0; l < 4; l++)
+        {
+            if (mask & (1 << l)) heap_offer(result, scores, i + l, better);
+        }
+    }
+#endif
+
+    // remaining scores (or all of them if SSE is not available)
+    for (; i < n; i++)
+    {
+        if (better_t::passes(scores[i], result.front().first)) heap_offer(result, scores, i, better);
+    }
+
+    std::sort_heap(result.begin(), result.end(), better);
+}
+
+
+template <class better_t>
+void select_k(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result)
+{
+    // candidates use a 32-bit index
+    assert(n <= std::numeric_limits<uint32_t>::max());
+
+    result.clear();
+    k = std::min(k, n);
+    if (k == 0) return;
+
+    // heuristic: if we are going to retain more than about 1/16th of all
+    // scores, partitioning is faster than maintaining the heap
+    if (k * 16 >= n) select_nth_element<better_t>(scores, n, k, result);
+    else select_heap<better_t>(scores, n, k, result);
+}
+
+} // anonymous namespace
+
+
+void select_k_smallest(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result)
+{
+    select_k<better_smaller>(scores, n, k, result);
+}
+
+void select_k_largest(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result)
+{
+    select_k<better_larger>(scores, n, k, result);
+}
+
+} // namespace imdb
@@ -0,0 +1,51 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef TOP_K_HPP
+#define TOP_K_HPP
+
+#include "../util/types.hpp"
+
+namespace imdb
+{
+
+/**
+ * \addtogroup search
+ * @{
+ */
+
+/**
+ * @brief Exact selection of the k smallest values out of scores[0..n).
+ *
+ * Use this when scores contains distances, i.e. smaller values denote better matches. For small k a
+ * bounded heap is used and the scores are scanned against the current k-th best value (using SSE if available)
+ * such that the vast majority of scores never touches the heap. For large k (relative to n) selection is
+ * done using std::nth_element.
+ *
+ * @param scores Pointer to n scores
+ * @param n Number of scores, must be smaller than 2^32
+ * @param k Number of results to select, if k > n all n scores are returned
+ * @param result Sorted ascending by score, ties are broken by the smaller index. Any previous content is cleared.
+ */
+void select_k_smallest(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result);
+
+/**
+ * @brief Exact selection of the k largest values out of scores[0..n).
+ *
+ * Use this when scores contains similarities, i.e. larger values denote better matches (e.g. the
+ * accumulators of the InvertedIndex). See select_k_smallest() for details.
+ *
+ * @param result Sorted descending by score, ties are broken by the smaller index. Any previous content is cleared.
+ */
+void select_k_largest(const float* scores, size_t n, size_t k, vector<dist_idx_f32_t>& result);
+
+/** @} */
+
+} // namespace imdb
+
+#endif // TOP_K_HPP
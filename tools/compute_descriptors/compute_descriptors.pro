@@ -21,7 +21,14 @@ SOURCES += main.cpp \
     descriptors/image_sampler.cpp \
     descriptors/utilities.cpp \
     io/compute_descriptors.cpp \
-    io/ordered_push_back.cpp
+    io/ordered_push_back.cpp \
+    util/quantizer.cpp \
+    util/vocabulary_tree.cpp \
+    util/kdforest.cpp \
+    util/batch_quantizer.cpp \
+    search/inverted_index.cpp \
+    search/top_k.cpp \
+    search/tf_idf.cpp
 
 
 HEADERS += util/types.hpp \
@@ -37,4 +44,6 @@ HEADERS += util/types.hpp \
     descriptors/shog.hpp \
     descriptors/galif.hpp \
     io/compute_descriptors.hpp \
-    io/ordered_push_back.hpp
+    io/ordered_push_back.hpp \
+    util/histvw_builder.hpp \
+    search/inverted_index.hpp
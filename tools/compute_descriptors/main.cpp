@@ -9,6 +9,8 @@ the terms of the BSD license (see the LICENSE file).
 #include <QDateTime>
 #include <QTime>
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <queue>
 #include <stdexcept>
@@ -17,11 +19,16 @@ the terms of the BSD license (see the LICENSE file).
 #include <boost/algorithm/string.hpp>
 
 #include <io/property_writer.hpp>
+#include <io/property_journal.hpp>
 #include <io/cmdline.hpp>
 #include <io/filelist.hpp>
 #include <io/compute_descriptors.hpp>
+#include <io/ordered_push_back.hpp>
 #include <util/progress.hpp>
 #include <util/types.hpp>
+#include <util/histvw_builder.hpp>
+#include <search/inverted_index.hpp>
+#include <search/tf_idf.hpp>
 #include <descriptors/generator.hpp>
 
 
@@ -103,6 +110,130 @@ void print_available_generators()
     }
 }
 
+// Creates the generator with the parameters given as key=value strings, returns
+// an empty pointer (after printing the reason) if that fails
+boost::shared_ptr<Generator> make_generator(const std::string& name, const std::vector<std::string>& in_params)
+{
+    ptree params;
+    params.put("generator.name", name);
+    for (size_t i = 0; i < in_params.size(); i++)
+    {
+        std::vector<std::string> pv;
+        boost::algorithm::split(pv, in_params[i], boost::algorithm::is_any_of("="));
+
+        if (pv.size() != 1 && pv.size() != 2)
+        {
+            std::cerr << "compute_descriptors: cannot parse descriptor parameter: " << in_params[i] << std::endl;
+            return boost::shared_ptr<Generator>();
+        }
+        params.put(pv[0], (pv.size() == 2) ? pv[1] : "");
+    }
+
+    // Typical failure case for this is that the JSON parameters
+    // contains an unregistered name for a Generator/ImageSampler
+    try
+    {
+        return Generator::from_parameters(params);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return boost::shared_ptr<Generator>();
+    }
+}
+
+// Loads the list of files to compute descriptors from, prints the reason if that fails
+bool load_files(FileList& files, const std::string& rootdir, const std::string& filelist)
+{
+    try { files.set_root_dir(rootdir); }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Exception in compute_descriptors: " << e.what() << std::endl;
+        return false;
+    }
+
+    try { files.load(filelist); }
+    catch(std::exception& e)
+    {
+        std::cerr << "compute_descriptors: failed to load filelist from file " << filelist << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Builds the histogram of visual words of each file as soon as the generator has computed its
+// local descriptors and adds the histograms to an inverted index in the order of the files, such
+// that neither descriptors nor histograms need to be written to and read back from disk.
+// Optionally, the histograms are written as well.
+class index_consumer
+{
+    public:
+
+    index_consumer(const histvw_builder& builder, shared_ptr<PropertyWriter> histvw)
+        : _builder(builder)
+        , _numAdded(0)
+    {
+        if (histvw) _histvw = boost::make_shared<OrderedPushBack>(histvw);
+    }
+
+    // called concurrently by the computing threads
+    void consume(size_t index, const anymap_t& data)
+    {
+        anymap_t::const_iterator it = data.find("features");
+        const vec_vec_f32_t* samples = (it != data.end()) ? boost::any_cast<vec_vec_f32_t>(&it->second) : 0;
+        if (!samples) throw std::runtime_error("compute_descriptors: the generator does not compute local features (vec_vec_f32_t) that could be quantized");
+
+        static const vec_vec_f32_t no_positions;
+        it = data.find("positions");
+        const vec_vec_f32_t* positions = (it != data.end()) ? boost::any_cast<vec_vec_f32_t>(&it->second) : 0;
+        if (!positions && _builder.pyramidlevels > 1) throw std::runtime_error("compute_descriptors: spatial pyramids require a generator that computes the positions of its features");
+
+        shared_ptr<vec_f32_t> hist = boost::make_shared<vec_f32_t>();
+        _builder(*samples, positions ? *positions : no_positions, *hist);
+        if (_histvw) _histvw->push_back(index, *hist);
+
+        boost::lock_guard<boost::mutex> lock(_mutex);
+        _queue.push(queue_element(index, hist));
+
+        // the index identifies documents by the order they have been added in
+        while (!_queue.empty() && _queue.top().first == _numAdded)
+        {
+            const vec_f32_t& h = *_queue.top().second;
+            if (!_index) _index = boost::make_shared<InvertedIndex>(h.size());
+            _index->addHistogram(h);
+            _queue.pop();
+            _numAdded++;
+        }
+    }
+
+    // the index of all histograms, empty if no histogram has been added
+    shared_ptr<InvertedIndex> index() const
+    {
+        return _index;
+    }
+
+    bool empty_buffer() const
+    {
+        return _queue.empty() && (!_histvw || _histvw->empty_buffer());
+    }
+
+    private:
+
+    const histvw_builder&       _builder;
+    shared_ptr<OrderedPushBack> _histvw;
+    shared_ptr<InvertedIndex>   _index;
+    size_t                      _numAdded;
+    boost::mutex                _mutex;
+
+    // histograms waiting for their predecessors
+    typedef std::pair<size_t, shared_ptr<vec_f32_t> >   queue_element;
+    typedef std::greater<queue_element>                 queue_compare;
+    typedef std::priority_queue<queue_element, std::vector<queue_element>, queue_compare> queue_t;
+
+    queue_t _queue;
+};
+
 class command_compute : public Command
 {
 public:
@@ -114,6 +245,10 @@ public:
         , _co_output    ("output"           , "o", "output prefix [required]")
         , _co_params    ("parameters"       , "p", "parameters for generator construction [optional] (default: params defined in generator)")
         , _co_numthreads("numthreads"       , "t", "number of threads for parallel computation [optional] (default: number of processors)")
+        , _co_compression("compression"     , "c", "store the descriptors in compressed blocks: none, lz4 or zstd [optional] (default: none)")
+        , _co_shuffle   ("shuffle"          , "s", "shuffle the bytes of words of this size before compression, e.g. 4 for floats [optional] (default: 0, no shuffling)")
+        , _co_resume    ("resume"           , "u", "continue an interrupted computation, keeping the descriptors already written to the output [optional]")
+        , _co_dense     ("dense"            , "d", "store descriptors of fixed dimension as dense matrices, which load much faster [optional]")
 
     {
         add(_co_rootdir);
@@ -121,6 +256,10 @@ public:
         add(_co_output);
         add(_co_params);
         add(_co_numthreads);
+        add(_co_compression);
+        add(_co_shuffle);
+        add(_co_resume);
+        add(_co_dense);
     }
 
 
@@ -173,58 +312,37 @@ public:
 
         _co_params.parse_multiple<std::string>(args, in_params);
 
-
-        ptree params;
-        params.put("generator.name", in_generator);
-        for (size_t i = 0; i < in_params.size(); i++)
+        PropertyCompression in_compression;
+        std::string in_codec;
+        if (_co_compression.parse_single<std::string>(args, in_codec))
         {
-            std::vector<std::string> pv;
-            boost::algorithm::split(pv, in_params[i], boost::algorithm::is_any_of("="));
-
-            if (pv.size() != 1 && pv.size() != 2)
+            try { in_compression.codec = PropertyCompression::codec_from_name(in_codec); }
+            catch (const std::exception& e)
             {
-                std::cerr << "compute_descriptors: cannot parse descriptor parameter: " << in_params[i] << std::endl;
+                std::cerr << "compute_descriptors: " << e.what() << std::endl;
                 return false;
             }
-            params.put(pv[0], (pv.size() == 2) ? pv[1] : "");
         }
-
-        FileList files;
-        try { files.set_root_dir(in_rootdir); }
-        catch (const std::exception& e)
+        _co_shuffle.parse_single<std::size_t>(args, in_compression.shuffle);
+        bool in_resume = _co_resume.parse_flag(args);
+        bool in_dense = _co_dense.parse_flag(args);
+        if (in_dense && in_compression.codec != PropertyCompression::None)
         {
-            std::cerr << "Exception in compute_descriptors: " << e.what() << std::endl;
+            std::cerr << "compute_descriptors: dense output cannot be compressed" << std::endl;
             return false;
         }
 
+
+        FileList files;
         if (!_co_filelist.parse_single<std::string>(args, in_filelist))
         {
             print();
             return false;
         }
-        else
-        {
-            try { files.load(in_filelist); }
-            catch(std::exception& e)
-            {
-                std::cerr << "compute_descriptors: failed to load filelist from file " << in_filelist << ": " << e.what() << std::endl;
-                return false;
-            }
-        }
+        if (!load_files(files, in_rootdir, in_filelist)) return false;
 
-        // Create generator. Typical failure case for this
-        // is that the JSON parameters contains an unregistered
-        // name for a Generator/ImageSampler
-        boost::shared_ptr<Generator> generator;
-        try
-        {
-            generator = Generator::from_parameters(params);
-        }
-        catch (const std::exception& e)
-        {
-            std::cerr << e.what() << std::endl;
-            return false;
-        }
+        boost::shared_ptr<Generator> generator = make_generator(in_generator, in_params);
+        if (!generator) return false;
 
         // initialize a computing object
         ComputeDescriptors cd(generator, files);
@@ -233,12 +351,36 @@ public:
         PropertyWriters::properties_t& propertyWriters = generator->propertyWriters().get();
         PropertyWriters::properties_t::const_iterator cit = propertyWriters.begin();
 
-        for(; cit != propertyWriters.end(); ++cit)
+        // when resuming, all outputs continue behind the files that all of them contain
+        size_t first = 0;
+        if (in_resume)
+        {
+            first = files.size();
+            for (cit = propertyWriters.begin(); cit != propertyWriters.end(); ++cit)
+            {
+                string filename = in_output + cit->first;
+                try { first = std::min<size_t>(first, resumable_size(filename)); }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "compute_descriptors: cannot resume file " << filename << ": " << e.what() << std::endl;
+                    return false;
+                }
+            }
+            std::cout << "compute_descriptors: resuming at file " << first << "/" << files.size() << std::endl;
+        }
+
+        for(cit = propertyWriters.begin(); cit != propertyWriters.end(); ++cit)
         {
             const std::string& name = cit->first;
             string filename = in_output + name;
 
-            try { cit->second->open(filename); }
+            // resuming keeps the layout of the existing file
+            try
+            {
+                if (in_resume && std::ifstream(filename.c_str()).is_open()) cit->second->resume(filename, in_compression, first);
+                else if (in_dense) cit->second->open_dense(filename);
+                else cit->second->open(filename, in_compression);
+            }
             catch (const std::exception& e)
             {
                 std::cerr << "compute_descriptors: failed to open property writer on file " << filename << ": " << e.what() << std::endl;
@@ -248,7 +390,7 @@ public:
                 return false;
             }
 
-            cd.add_writer(name, cit->second);
+            cd.add_writer(name, cit->second, first);
         }
 
         // start computing descriptors
@@ -256,7 +398,7 @@ public:
 
         boost::thread obs(progress_observer, boost::ref(cd));
 
-        bool okay = cd.start(in_numthreads);
+        bool okay = cd.start(in_numthreads, first);
 
         int seconds = time.secsTo(QDateTime::currentDateTime());
         obs.join();
@@ -286,6 +428,235 @@ private:
     CmdOption _co_output;
     CmdOption _co_params;
     CmdOption _co_numthreads;
+    CmdOption _co_compression;
+    CmdOption _co_shuffle;
+    CmdOption _co_resume;
+    CmdOption _co_dense;
+};
+
+class command_index : public Command
+{
+public:
+
+    command_index()
+        : Command("index <generator> [options]\n"
+                  "computes local descriptors, quantizes them and adds the histograms of visual words to an inverted index in a single pass,\n"
+                  "i.e. the same as compute, compute_histvw and compute_index without writing and reading intermediate files")
+        , _co_rootdir      ("rootdir"        , "r", "root directory of data descriptors are computed from [required]")
+        , _co_filelist     ("filelist"       , "f", "file that contains filenames of data (images/models) [required]")
+        , _co_output       ("output"         , "o", "filename of the output index file [required]")
+        , _co_vocabulary   ("vocabulary"     , "v", "filename of the vocabulary to be used for quantization [required]")
+        , _co_quantization ("quantization"   , "q", "quantization method {hard,fuzzy,fuzzyknn,tree,approx} [required], see compute_histvw")
+        , _co_tfidf        ("tfidf"          , "w", "two strings specifying tf and idf function to be used [required]")
+        , _co_params       ("parameters"     , "p", "parameters for generator construction [optional] (default: params defined in generator)")
+        , _co_numthreads   ("numthreads"     , "t", "number of threads for parallel computation [optional] (default: number of processors)")
+        , _co_sigma        ("sigma"          , "s", "sigma for gaussian weighting in fuzzy quantization [required (with 'fuzzy' and 'fuzzyknn' quantization only)]")
+        , _co_pyramidlevels("pyramidlevels"  , "l", "number of spatial pyramid levels [optional, default 1]")
+        , _co_knn          ("knn"            , "k", "number of nearest words a descriptor is assigned to [optional, default 5, only used with 'fuzzyknn' quantization]")
+        , _co_checks       ("checks"         , "c", "maximum number of words compared to each descriptor [optional, default 128, only used with 'approx' quantization]")
+        , _co_descriptors  ("descriptors"    , "d", "output prefix, additionally write the descriptors as compute does [optional]")
+        , _co_histvw       ("histvw"         , "h", "additionally write the histograms of visual words to this file [optional]")
+    {
+        add(_co_rootdir);
+        add(_co_filelist);
+        add(_co_output);
+        add(_co_vocabulary);
+        add(_co_quantization);
+        add(_co_tfidf);
+        add(_co_params);
+        add(_co_numthreads);
+        add(_co_sigma);
+        add(_co_pyramidlevels);
+        add(_co_knn);
+        add(_co_checks);
+        add(_co_descriptors);
+        add(_co_histvw);
+    }
+
+
+    bool run(const std::vector<std::string>& args)
+    {
+        if (args.size() == 0)
+        {
+            print();
+            return false;
+        }
+
+        warn_for_unknown_option(args);
+
+        std::string in_generator(args[0]);
+
+        if (!Generator::generators().count(in_generator))
+        {
+            std::cerr << "compute_descriptors: no generator named " << in_generator << std::endl;
+            print_available_generators();
+            return false;
+        }
+
+        std::string in_rootdir;
+        std::string in_filelist;
+        std::string in_output;
+        std::string in_vocabulary;
+        std::vector<std::string> in_tfidf;
+        std::vector<std::string> in_params;
+        std::string in_descriptors;
+        std::string in_histvw;
+        size_t in_checks = 128;
+
+        histvw_builder builder;
+
+        if (!_co_rootdir.parse_single<std::string>(args, in_rootdir)
+                || !_co_filelist.parse_single<std::string>(args, in_filelist)
+                || !_co_output.parse_single<std::string>(args, in_output)
+                || !_co_vocabulary.parse_single<std::string>(args, in_vocabulary)
+                || !_co_quantization.parse_single<std::string>(args, builder.quantization)
+                || !_co_tfidf.parse_multiple<std::string>(args, in_tfidf)
+                || in_tfidf.size() != 2)
+        {
+            print();
+            return false;
+        }
+
+        if ((builder.quantization == "fuzzy" || builder.quantization == "fuzzyknn") && !_co_sigma.parse_single<float>(args, builder.sigma))
+        {
+            std::cerr << "compute_descriptors: you must provide a value for 'sigma' when selecting 'fuzzy' or 'fuzzyknn' quantization" << std::endl;
+            print();
+            return false;
+        }
+
+        _co_params.parse_multiple<std::string>(args, in_params);
+        _co_pyramidlevels.parse_single<size_t>(args, builder.pyramidlevels);
+        _co_knn.parse_single<size_t>(args, builder.knn);
+        _co_checks.parse_single<size_t>(args, in_checks);
+        _co_descriptors.parse_single<std::string>(args, in_descriptors);
+        _co_histvw.parse_single<std::string>(args, in_histvw);
+
+        if (builder.pyramidlevels == 0 || builder.knn == 0)
+        {
+            std::cerr << "compute_descriptors: pyramidlevels and knn must be at least 1" << std::endl;
+            return false;
+        }
+
+        int in_numthreads = boost::thread::hardware_concurrency();
+        if (_co_numthreads.parse_single<int>(args, in_numthreads) && in_numthreads < 1)
+        {
+            std::cout << "compute_descriptors: number of threads should be > 0, using default" << std::endl;
+            in_numthreads = boost::thread::hardware_concurrency();
+        }
+        in_numthreads = std::max(in_numthreads, 1);
+        std::cout << "compute_descriptors: using " << in_numthreads << " threads" << std::endl;
+
+        FileList files;
+        if (!load_files(files, in_rootdir, in_filelist)) return false;
+
+        boost::shared_ptr<Generator> generator = make_generator(in_generator, in_params);
+        if (!generator) return false;
+
+        try
+        {
+            std::cout << "compute_descriptors: using " << builder.load(in_vocabulary, in_checks) << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "compute_descriptors: failed to read vocabulary: " << e.what() << std::endl;
+            return false;
+        }
+
+        std::cout << "compute_descriptors: tf=" << in_tfidf[0] << ", idf=" << in_tfidf[1] << std::endl;
+        shared_ptr<tf_function>  tf = make_tf(in_tfidf[0]);
+        shared_ptr<idf_function> idf = make_idf(in_tfidf[1]);
+
+        ComputeDescriptors cd(generator, files);
+
+        // intermediate outputs are optional, by default nothing but the index gets written
+        shared_ptr<PropertyWriter> histvw;
+        try
+        {
+            if (!in_descriptors.empty())
+            {
+                PropertyWriters::properties_t& propertyWriters = generator->propertyWriters().get();
+                for (PropertyWriters::properties_t::const_iterator cit = propertyWriters.begin(); cit != propertyWriters.end(); ++cit)
+                {
+                    cit->second->open(in_descriptors + cit->first);
+                    cd.add_writer(cit->first, cit->second);
+                }
+            }
+
+            if (!in_histvw.empty()) histvw = boost::make_shared<PropertyWriterT<vec_f32_t> >(in_histvw);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "compute_descriptors: failed to open property writer: " << e.what() << std::endl;
+            return false;
+        }
+
+        index_consumer consumer(builder, histvw);
+        cd.add_consumer(boost::bind(&index_consumer::consume, &consumer, _1, _2));
+
+        QDateTime time = QDateTime::currentDateTime();
+
+        boost::thread obs(progress_observer, boost::ref(cd));
+
+        bool okay = cd.start(in_numthreads) && consumer.empty_buffer();
+
+        obs.join();
+
+        if (!okay)
+        {
+            std::cerr << "compute_descriptors: error during computation occured" << std::endl;
+            return false;
+        }
+
+        shared_ptr<InvertedIndex> index = consumer.index();
+        if (!index)
+        {
+            std::cerr << "compute_descriptors: no histograms have been computed" << std::endl;
+            return false;
+        }
+
+        try
+        {
+            std::cout << "compute_descriptors: finalizing index" << std::endl;
+            index->finalize(*index, *tf, *idf);
+            std::cout << "compute_descriptors: saving index" << std::endl;
+            index->save(in_output);
+
+            // the same parameters are required to compute the descriptors of queries
+            std::string filename = in_descriptors.empty() ? in_output + ".parameters" : in_descriptors + "parameters";
+            boost::property_tree::write_json(filename, generator->parameters());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "compute_descriptors: failed to write index: " << e.what() << std::endl;
+            return false;
+        }
+
+        int seconds = time.secsTo(QDateTime::currentDateTime());
+        int fmth = seconds / 3600;
+        int fmtm = seconds / 60 % 60;
+        int fmts = seconds % 60;
+        std::cout << "finished." << std::endl;
+        std::cout << "duration: " << fmth << "h " << fmtm << "m " << fmts << "s" << " (" << seconds << " s)" << std::endl;
+
+        return true;
+    }
+
+private:
+
+    CmdOption _co_rootdir;
+    CmdOption _co_filelist;
+    CmdOption _co_output;
+    CmdOption _co_vocabulary;
+    CmdOption _co_quantization;
+    CmdOption _co_tfidf;
+    CmdOption _co_params;
+    CmdOption _co_numthreads;
+    CmdOption _co_sigma;
+    CmdOption _co_pyramidlevels;
+    CmdOption _co_knn;
+    CmdOption _co_checks;
+    CmdOption _co_descriptors;
+    CmdOption _co_histvw;
 };
 
 class command_info : public Command
@@ -367,6 +738,7 @@ int main(int argc, char *argv[])
     typedef std::map<std::string, std::pair<boost::shared_ptr<Command>, std::string> > cmd_map_t;
     cmd_map_t cmd_desc;
     cmd_desc["compute"]    = std::make_pair(boost::make_shared<command_compute>()   , "compute descriptors");
+    cmd_desc["index"]      = std::make_pair(boost::make_shared<command_index>()     , "compute descriptors, quantize them and build an inverted index in one pass");
     cmd_desc["info"]       = std::make_pair(boost::make_shared<command_info>()      , "print informations of specific generator");
     cmd_desc["list"]       = std::make_pair(boost::make_shared<command_list>()      , "print list of available generators");
 
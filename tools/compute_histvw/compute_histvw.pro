@@ -8,7 +8,13 @@ CONFIG += console
 #QMAKE_CXXFLAGS += -fopenmp
 #LIBS += -lgomp
 
+LIBS += -lboost_thread-mt
+
 SOURCES += main.cpp \
 io/filelist.cpp \
-util/quantizer.cpp
+util/quantizer.cpp \
+util/vocabulary_tree.cpp \
+util/kdforest.cpp \
+util/batch_quantizer.cpp \
+io/ordered_push_back.cpp
 
@@ -11,12 +11,17 @@ the terms of the BSD license (see the LICENSE file).
 #include <iostream>
 #include <algorithm>
 
+#include <boost/thread.hpp>
+
 #include <util/types.hpp>
 #include <util/progress.hpp>
-#include <util/quantizer.hpp>
+#include <util/histvw_builder.hpp>
+#include <util/bounded_queue.hpp>
 
 #include <io/property_reader.hpp>
+#include <io/property_scanner.hpp>
 #include <io/property_writer.hpp>
+#include <io/ordered_push_back.hpp>
 #include <io/cmdline.hpp>
 
 #include <search/distance.hpp>
@@ -25,6 +30,120 @@ the terms of the BSD license (see the LICENSE file).
 
 using namespace imdb;
 
+
+// The samples and positions of a single image, passed from the reader to the workers
+struct histvw_job
+{
+    index_t       index;
+    vec_vec_f32_t samples;
+    vec_vec_f32_t positions;
+};
+
+typedef shared_ptr<histvw_job> histvw_job_ptr;
+
+
+// Pipeline computing the histograms of all images: a single reader thread collects the
+// read-ahead descriptors and positions of the next images, a pool of workers each quantizes whole
+// images and the resulting histograms are written in the original order.
+class histvw_pipeline
+{
+    public:
+
+    histvw_pipeline(const histvw_builder& builder, const PropertyReaderT<vec_vec_f32_t>& descriptors, const PropertyReaderT<vec_vec_f32_t>& positions, shared_ptr<PropertyWriter> writer, size_t numthreads)
+        : _builder(builder)
+        , _descriptors(descriptors)
+        , _positions(positions)
+        , _writer(writer)
+        , _queue(2*numthreads)
+        , _numthreads(numthreads)
+        , _progress(10)
+        , _numDone(0)
+        , _error(false)
+    {}
+
+    bool run()
+    {
+        boost::thread_group pool;
+        pool.create_thread(boost::bind(&histvw_pipeline::read, this));
+        for (size_t i = 0; i < _numthreads; i++) pool.create_thread(boost::bind(&histvw_pipeline::work, this));
+        pool.join_all();
+
+        // a histogram that is still buffered means that one of its predecessors never got written
+        return !_error && _writer.empty_buffer();
+    }
+
+    private:
+
+    void read()
+    {
+        try
+        {
+            // both files are read ahead in the background, each by a thread of its own
+            PropertyScannerT<vec_vec_f32_t> descriptors(_descriptors, 4*_numthreads);
+            PropertyScannerT<vec_vec_f32_t> positions(_positions, 4*_numthreads);
+
+            for (;;)
+            {
+                histvw_job_ptr job = boost::make_shared<histvw_job>();
+                if (_error || !descriptors.next(job->samples, job->index) || !positions.next(job->positions)) break;
+                if (!_queue.push(job)) break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            fail(e);
+        }
+
+        _queue.close();
+    }
+
+    void work()
+    {
+        histvw_job_ptr job;
+        while (_queue.pop(job))
+        {
+            try
+            {
+                vec_f32_t hist;
+                _builder(job->samples, job->positions, hist);
+                _writer.push_back(job->index, hist);
+            }
+            catch (const std::exception& e)
+            {
+                fail(e);
+                return;
+            }
+
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _progress(_numDone++, _descriptors.size(), "compute_histvw progress: ");
+        }
+    }
+
+    void fail(const std::exception& e)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            std::cerr << "compute_histvw: failed to read/write data: " << e.what() << std::endl;
+            _error = true;
+        }
+        _queue.close();
+    }
+
+    const histvw_builder&                 _builder;
+    const PropertyReaderT<vec_vec_f32_t>& _descriptors;
+    const PropertyReaderT<vec_vec_f32_t>& _positions;
+    OrderedPushBack                       _writer;
+    BoundedQueue<histvw_job_ptr>          _queue;
+    size_t                                _numthreads;
+
+    // protects the progress output and error reporting
+    progress_output _progress;
+    size_t          _numDone;
+    volatile bool   _error;
+    boost::mutex    _mutex;
+};
+
+
 class command_compute : public Command
 {
 public:
@@ -34,10 +153,13 @@ public:
         , _co_vocabulary("vocabulary"        , "v", "filename of the vocabulary to be used for quantization [required]")
         , _co_descriptors("descriptors"      , "d", "filename of the descriptors to convert into histograms of visual words [required]")
         , _co_positions("positions"          , "p", "positions data for features [required]")
-        , _co_quantization("quantization"    , "q", "quantization method {hard,fuzzy} [required]")
-        , _co_sigma("sigma"                  , "s", "sigma for gaussian weighting in fuzzy quantization [required (with 'fuzzy' quantization only)]")
+        , _co_quantization("quantization"    , "q", "quantization method {hard,fuzzy,fuzzyknn,tree,approx} [required] ('fuzzyknn' only weights the --knn nearest words, 'tree' requires a vocabulary tree generated by compute_vocabulary --branching, 'approx' searches the nearest word in a randomized k-d forest)")
+        , _co_sigma("sigma"                  , "s", "sigma for gaussian weighting in fuzzy quantization [required (with 'fuzzy' and 'fuzzyknn' quantization only)]")
         , _co_output("output"                , "o", "filename of the output file of histograms of visual words [required]")
         , _co_pyramidlevels("pyramidlevels"  , "l", "number of spatial pyramid levels [optional, default 1]")
+        , _co_knn("knn"                      , "k", "number of nearest words a descriptor is assigned to [optional, default 5, only used with 'fuzzyknn' quantization]")
+        , _co_checks("checks"                , "c", "maximum number of words compared to each descriptor [optional, default 128, only used with 'approx' quantization]")
+        , _co_numthreads("numthreads"        , "t", "number of worker threads, each quantizing whole images (default: number of processors) [optional]")
     {
         add(_co_vocabulary);
         add(_co_descriptors);
@@ -46,6 +168,9 @@ public:
         add(_co_quantization);
         add(_co_sigma);
         add(_co_pyramidlevels);
+        add(_co_knn);
+        add(_co_checks);
+        add(_co_numthreads);
     }
 
 
@@ -65,13 +190,16 @@ public:
         string in_positions;
         string in_quantization;
         string in_output;
-        float  in_sigma;
+        float  in_sigma = 0;
 
         // Default values if no command line parameters are provided
         // Those default parameters essentially mean no spatial
         // subdivision of the histogram of visual words (i.e. creation of
         // an original bag-of-features histogram
         size_t in_pyramidlevels = 1;
+        size_t in_knn = 5;
+        size_t in_checks = 128;
+        int    in_numthreads = boost::thread::hardware_concurrency();
 
         // check that the required options are available
         if (!_co_vocabulary.parse_single<string>(args, in_vocabulary)
@@ -86,20 +214,20 @@ public:
 
 
         // make sure that the qunatization option provided is either
-        // "fuzzy" or "hard"; provide a warning otherwise
-        if ((in_quantization != "fuzzy") && (in_quantization != "hard"))
+        // "fuzzy", "fuzzyknn", "hard", "tree" or "approx"; provide a warning otherwise
+        if ((in_quantization != "fuzzy") && (in_quantization != "fuzzyknn") && (in_quantization != "hard") && (in_quantization != "tree") && (in_quantization != "approx"))
         {
-            std::cerr << "compute_histvw: quantization method can only be {'fuzzy', 'hard'}. You provided: '" << in_quantization << "'. Exiting." << std::endl;
+            std::cerr << "compute_histvw: quantization method can only be {'fuzzy', 'fuzzyknn', 'hard', 'tree', 'approx'}. You provided: '" << in_quantization << "'. Exiting." << std::endl;
             return false;
         }
 
         // we require that sigma is also provided when
         // fuzzy clustering has been selected
-        if (in_quantization == "fuzzy")
+        if (in_quantization == "fuzzy" || in_quantization == "fuzzyknn")
         {
             if (!_co_sigma.parse_single<float>(args, in_sigma))
             {
-                std::cerr << "compute_histvw: you must provide a value for 'sigma' when selecting 'fuzzy' quantization" << std::endl;
+                std::cerr << "compute_histvw: you must provide a value for 'sigma' when selecting 'fuzzy' or 'fuzzyknn' quantization" << std::endl;
                 print();
                 return false;
             }
@@ -108,17 +236,42 @@ public:
 
         // check for optional arguments
         _co_pyramidlevels.parse_single<size_t>(args, in_pyramidlevels);
+        _co_knn.parse_single<size_t>(args, in_knn);
+        _co_checks.parse_single<size_t>(args, in_checks);
+
+        if (in_pyramidlevels == 0)
+        {
+            std::cerr << "compute_histvw: pyramidlevels must be at least 1" << std::endl;
+            return false;
+        }
+
+        if (in_knn == 0)
+        {
+            std::cerr << "compute_histvw: knn must be at least 1" << std::endl;
+            return false;
+        }
+
+        if (_co_numthreads.parse_single<int>(args, in_numthreads) && in_numthreads < 1)
+        {
+            std::cout << "compute_histvw: number of threads should be > 0, using default" << std::endl;
+            in_numthreads = boost::thread::hardware_concurrency();
+        }
+        in_numthreads = std::max(in_numthreads, 1);
 
         // ----------------------------------------------
         // we now have parse all relevant commandline
         // parameters and are ready to compute....
         // ----------------------------------------------
 
-        vec_vec_f32_t vocabulary;
+        histvw_builder builder;
+        builder.quantization = in_quantization;
+        builder.pyramidlevels = in_pyramidlevels;
+        builder.knn = in_knn;
+        builder.sigma = in_sigma;
 
         try
         {
-            read_property(vocabulary, in_vocabulary);
+            std::cout << "compute_histvw: using " << builder.load(in_vocabulary, in_checks) << std::endl;
         }
         catch (const std::exception& e)
         {
@@ -126,65 +279,20 @@ public:
             return false;
         }
 
-        typedef l2norm_squared<vec_f32_t> dist_fn_t;
-
-
-
-        quantize_fn quantizer; // boost::function, see quantizer.hpp for typedef
-        bool normalizeHistvw;
-
-        if (in_quantization == "fuzzy")
-        {
-            std::cout << "compute_histvw: using fuzzy clustering, sigma=" << in_sigma << std::endl;
-            quantizer = quantize_fuzzy<vec_f32_t, dist_fn_t>(in_sigma);
-            normalizeHistvw = true;
-        }
-        else if (in_quantization == "hard")
-        {
-            std::cout << "compute_histvw: using hard clustering" << std::endl;
-            quantizer = quantize_hard<vec_f32_t, dist_fn_t>();
-            normalizeHistvw = false;
-        }
-
-
-
         try {
-            PropertyWriterT<vec_f32_t> writer(in_output);
+            shared_ptr<PropertyWriter> writer = boost::make_shared<PropertyWriterT<vec_f32_t> >(in_output);
             PropertyReaderT<vec_vec_f32_t> reader_desc(in_descriptors);
             PropertyReaderT<vec_vec_f32_t> reader_pos(in_positions);
 
-            assert(reader_desc.size() == reader_pos.size());
-            std::cout << "compute_histvw: reader #entries=" << reader_desc.size() << std::endl;
-
-            progress_output progress(10);
-            for (index_t i = 0; i < reader_desc.size(); i++)
+            if (reader_desc.size() != reader_pos.size())
             {
-                vec_vec_f32_t samples(reader_desc[i]);
-                vec_vec_f32_t positions(reader_pos[i]);
-
-                // quantize all samples contained in the current vec_vec_f32_t in parallel, the
-                // result is again a vec_vec_f32_t which has the same size as the samples vector,
-                // i.e. one quantized sample for each original sample.
-                vec_vec_f32_t quantized_samples;
-                quantize_samples_parallel(samples, vocabulary, quantized_samples, quantizer);
-
-                vec_f32_t hist;
-
-                for (size_t j = 0; j < in_pyramidlevels; j++)
-                {
-                    vec_f32_t tmp;
-                    int res = 1 << j; // 2^j
-                    build_histvw(quantized_samples, vocabulary.size(), tmp, normalizeHistvw, positions, res);
-
-                    // append the current pyramid level histograms to
-                    // the overall histogram
-                    hist.insert(hist.end(), tmp.begin(), tmp.end());
-                }
-
-                progress(i, reader_desc.size(), "compute_histvw progress: ");
-
-                writer.push_back(hist);
+                std::cerr << "compute_histvw: descriptors and positions files contain a different number of entries" << std::endl;
+                return false;
             }
+            std::cout << "compute_histvw: reader #entries=" << reader_desc.size() << ", using " << in_numthreads << " threads" << std::endl;
+
+            histvw_pipeline pipeline(builder, reader_desc, reader_pos, writer, in_numthreads);
+            if (!pipeline.run()) return false;
         }
 
         // catch (most probably) i/o exceptions that occur when the user messed up a path/filename
@@ -208,6 +316,9 @@ private:
     CmdOption _co_sigma;
     CmdOption _co_output;
     CmdOption _co_pyramidlevels;
+    CmdOption _co_knn;
+    CmdOption _co_checks;
+    CmdOption _co_numthreads;
 };
 
 
@@ -7,12 +7,15 @@ CONFIG += console
 QMAKE_CXXFLAGS += -fopenmp
 LIBS += -lgomp
 
-LIBS += -lboost_iostreams-mt
+LIBS += -lboost_iostreams-mt -lboost_thread-mt
 
 HEADERS += search/inverted_index.hpp \
 util/quantizer.hpp
 
 SOURCES = main.cpp \
 util/quantizer.cpp \
+util/vocabulary_tree.cpp \
+util/kdforest.cpp \
 search/inverted_index.cpp \
+search/top_k.cpp \
 search/tf_idf.cpp
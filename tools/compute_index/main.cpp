@@ -16,6 +16,7 @@ the terms of the BSD license (see the LICENSE file).
 #include <util/quantizer.hpp>
 
 #include <io/property_reader.hpp>
+#include <io/property_scanner.hpp>
 #include <io/cmdline.hpp>
 
 #include <search/distance.hpp>
@@ -86,10 +87,16 @@ public:
 
             InvertedIndex index(vocabSize);
 
+            // histograms are read ahead in the background while
+            // the previous ones are added to the index
+            PropertyScannerT<vec_f32_t> scanner(reader, 1024);
+            vec_f32_t histogram;
+            index_t i;
+
             progress_output progress;
-            for (index_t i = 0; i < reader.size(); i++)
+            while (scanner.next(histogram, i))
             {
-                index.addHistogram(reader[i]);
+                index.addHistogram(histogram);
                 progress(i, reader.size(), "compute_index progress: ");
             }
 
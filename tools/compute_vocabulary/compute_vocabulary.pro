@@ -7,5 +7,9 @@ CONFIG += qt \
     thread \
     console
 
-SOURCES = main.cpp
-LIBS += -lboost_thread-mt
+SOURCES = main.cpp \
+util/vocabulary_tree.cpp \
+util/streaming_kmeans.cpp \
+io/float_matrix.cpp
+LIBS += -lboost_thread-mt \
+    -lboost_iostreams-mt
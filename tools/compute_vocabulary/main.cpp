@@ -7,12 +7,20 @@ the terms of the BSD license (see the LICENSE file).
 */
 
 #include <iostream>
+#include <set>
 #include <string>
 #include <vector>
 
+#include <boost/random.hpp>
+
 #include <util/types.hpp>
 #include <util/kmeans.hpp>
+#include <util/hierarchical_kmeans.hpp>
+#include <util/streaming_kmeans.hpp>
+#include <io/float_matrix.hpp>
 #include <io/property_reader.hpp>
+#include <io/mapped_property_reader.hpp>
+#include <io/property_scanner.hpp>
 #include <io/property_writer.hpp>
 #include <io/cmdline.hpp>
 #include <search/distance.hpp>
@@ -68,22 +76,28 @@ void sampleWords(const std::string& descriptorFile, const std::string& sizeFile,
     std::cout << "compute_vocabulary: extracting samples from descriptor file" << std::endl;
 
 
+    // compressed descriptor files cannot be mapped, their features are decompressed instead
     PropertyReaderT<vec_vec_f32_t> reader(descriptorFile);
+    boost::scoped_ptr<MappedPropertyReaderT<vec_vec_f32_t> > mapped;
+    if (!reader.compressed()) mapped.reset(new MappedPropertyReaderT<vec_vec_f32_t>(descriptorFile));
 
     std::cout << "compute_vocabulary: reading " << (map_featureid_sampleids.size() / static_cast<float>(reader.size()))*100 << "% of all features to gather desired number of samples."  << std::endl;
 
     map<int, vector<int> >::const_iterator cit;
 
+    // only the sampled words are copied out of the mapped file
+    vector<array_view<float> > feature;
+    vec_vec_f32_t words;
     for (cit = map_featureid_sampleids.begin(); cit != map_featureid_sampleids.end(); ++cit) {
 
         int feature_id = cit->first;
-        vec_vec_f32_t feature;
-        reader.get(feature, feature_id);
+        if (mapped) mapped->view(feature, feature_id);
+        else reader.get(words, feature_id);
 
         const vector<int>& sample_ids = cit->second;
         for (size_t i = 0; i < sample_ids.size(); i++) {
             int sample_id = sample_ids[i];
-            data.push_back(feature[sample_id]);
+            data.push_back(mapped ? feature[sample_id].to_vector() : words[sample_id]);
         }
     }
 
@@ -96,17 +110,31 @@ void readAllWords(const std::string& descriptorFile, imdb::vec_vec_f32_t& data)
 {
     std::cout << "compute_vocabulary: extracting samples from descriptor file..." << std::endl;
 
-    PropertyReaderT<vec_vec_f32_t> reader(descriptorFile);
+    // compressed descriptor files cannot be mapped, they are scanned instead
+    PropertyReaderT<vec_vec_f32_t> file(descriptorFile);
+    if (file.compressed())
+    {
+        PropertyScannerT<vec_vec_f32_t> scanner(file);
+        vec_vec_f32_t words;
+        while (scanner.next(words)) data.insert(data.end(), words.begin(), words.end());
+
+        std::cout << "compute_vocabulary: done, data contains " << data.size() << " samples." << std::endl;
+        return;
+    }
+
+    MappedPropertyReaderT<vec_vec_f32_t> reader(descriptorFile);
+    reader.advise_sequential();
 
     // now extract exactly only those "words" from the feature vector
     // that correspond to the sample indices
     int currWordIndex = 0;
+    vector<array_view<float> > feature;
     for (index_t i = 0; i < reader.size(); i++)
     {
-        vec_vec_f32_t feature = reader[i];
+        reader.view(feature, i);
         for (size_t j = 0; j < feature.size(); j++)
         {
-            data.push_back(feature[j]);
+            data.push_back(feature[j].to_vector());
             currWordIndex++;
         }
     }
@@ -114,6 +142,74 @@ void readAllWords(const std::string& descriptorFile, imdb::vec_vec_f32_t& data)
     std::cout << "compute_vocabulary: done, data contains " << data.size() << " samples." << std::endl;
 }
 
+// Copies all words of the descriptor file into a matrix file, such that they can be
+// streamed during clustering without holding them in memory
+void writeAllWords(const std::string& descriptorFile, const std::string& matrixFile)
+{
+    std::cout << "compute_vocabulary: copying all words from descriptor file to matrix file " << matrixFile << std::endl;
+
+    // the dimension is known once the first word has been read
+    boost::scoped_ptr<FloatMatrixWriter> writer;
+
+    // compressed descriptor files cannot be mapped, they are scanned instead
+    PropertyReaderT<vec_vec_f32_t> file(descriptorFile);
+    if (file.compressed())
+    {
+        PropertyScannerT<vec_vec_f32_t> scanner(file);
+        vec_vec_f32_t words;
+        while (scanner.next(words))
+        {
+            for (size_t j = 0; j < words.size(); j++)
+            {
+                if (!writer) writer.reset(new FloatMatrixWriter(matrixFile, words[j].size()));
+                writer->push_back(words[j]);
+            }
+        }
+    }
+    else
+    {
+        MappedPropertyReaderT<vec_vec_f32_t> reader(descriptorFile);
+        reader.advise_sequential();
+
+        vector<array_view<float> > feature;
+        for (index_t i = 0; i < reader.size(); i++)
+        {
+            reader.view(feature, i);
+            for (size_t j = 0; j < feature.size(); j++)
+            {
+                if (!writer) writer.reset(new FloatMatrixWriter(matrixFile, feature[j].size()));
+                writer->push_back(feature[j].data(), feature[j].size());
+            }
+        }
+    }
+
+    if (!writer) throw std::runtime_error("descriptor file " + descriptorFile + " does not contain any words");
+    writer->close();
+
+    std::cout << "compute_vocabulary: done, matrix contains " << writer->rows() << " words." << std::endl;
+}
+
+// Copies numRows distinct randomly chosen rows of the matrix. The rows are chosen with Floyd's
+// algorithm, which only needs memory for the chosen rows, not for all rows of the matrix
+void sampleRows(const MappedFloatMatrix& matrix, size_t numRows, imdb::vec_vec_f32_t& data)
+{
+    numRows = std::min(numRows, matrix.rows());
+
+    boost::mt19937 rng;
+    std::set<size_t> chosen;
+    for (size_t j = matrix.rows() - numRows; j < matrix.rows(); j++)
+    {
+        size_t t = boost::uniform_int<size_t>(0, j)(rng);
+        if (!chosen.insert(t).second) chosen.insert(j);
+    }
+
+    // read in file order
+    std::vector<size_t> rows(chosen.begin(), chosen.end());
+
+    data.resize(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) matrix.get(data[i], rows[i]);
+}
+
 class command_compute : public Command
 {
 public:
@@ -128,6 +224,13 @@ public:
         , _co_numthreads("numthreads"       , "t", "number of threads for parallel computation (default: number of processors) [optional]")
         , _co_maxiter   ("maxiter"          , "i", "kmeans stopping criterion: maximum number of iterations (default: 20) [optional]")
         , _co_minchangesfraction("minchangesfraction" , "m", "kmeans stopping criterion: number of changes (fraction of total samples) (default: 0.01) [optional]")
+        , _co_branching ("branching"        , "b", "build a vocabulary tree with this branching factor instead of a flat vocabulary, the tree has at least numclusters words [optional]")
+        , _co_depth     ("depth"            , "l", "number of levels of the vocabulary tree (default: smallest depth giving at least numclusters words) [optional, only with --branching]")
+        , _co_batchsize ("batchsize"        , "z", "use mini-batch kmeans with this number of samples per iteration instead of standard kmeans, with --branching for each node with more samples than this [optional]")
+        , _co_batchiter ("batchiterations"  , "e", "mini-batch kmeans: maximum number of iterations (default: 500) [optional, only with --batchsize]")
+        , _co_algorithm ("algorithm"        , "a", "kmeans algorithm: lloyd or hamerly, hamerly gives the same result but skips most distance computations (default: lloyd) [optional]")
+        , _co_init      ("init"             , "k", "initialization of the kmeans centers: random, plusplus (kmeans++) or parallel (kmeans||) (default: random) [optional]")
+        , _co_matrixfile("matrixfile"       , "x", "out-of-core training on all words: copy the words to this matrix file and stream it from disk during clustering instead of loading the words into memory [optional]")
     {
         add(_co_descfile);
         add(_co_sizefile);
@@ -137,6 +240,13 @@ public:
         add(_co_numthreads);
         add(_co_maxiter);
         add(_co_minchangesfraction);
+        add(_co_branching);
+        add(_co_depth);
+        add(_co_batchsize);
+        add(_co_batchiter);
+        add(_co_algorithm);
+        add(_co_init);
+        add(_co_matrixfile);
     }
 
 
@@ -197,6 +307,66 @@ public:
             return false;
         }
 
+        string in_init = "random";
+        _co_init.parse_single<string>(args, in_init);
+
+        KmeansInitAlgorithm initalgorithm = KmeansInitRandom;
+        if (in_init == "plusplus") initalgorithm = KmeansInitPlusPlus;
+        else if (in_init == "parallel") initalgorithm = KmeansInitParallel;
+        else if (in_init != "random")
+        {
+            std::cerr << "compute_vocabulary: unknown kmeans initialization " << in_init << std::endl;
+            return false;
+        }
+
+        string in_matrixfile;
+        if (_co_matrixfile.parse_single<string>(args, in_matrixfile))
+        {
+            // the other clustering modes need all samples in memory
+            int unused_int;
+            string unused_string;
+            if (has_sizefile || _co_branching.parse_single<int>(args, unused_int) || _co_batchsize.parse_single<int>(args, unused_int)
+                    || _co_algorithm.parse_single<string>(args, unused_string))
+            {
+                std::cerr << "compute_vocabulary: --matrixfile cannot be combined with sampling, --branching, --batchsize or --algorithm" << std::endl;
+                return false;
+            }
+
+            try
+            {
+                writeAllWords(in_descfile, in_matrixfile);
+                MappedFloatMatrix matrix(in_matrixfile);
+
+                if (matrix.rows() < static_cast<size_t>(in_numclusters))
+                {
+                    std::cerr << "compute_vocabulary: less words than clusters" << std::endl;
+                    return false;
+                }
+
+                // the initial centers are chosen from a random subset of the words that fits into memory
+                vec_vec_f32_t subset;
+                sampleRows(matrix, (initalgorithm == KmeansInitRandom) ? in_numclusters : 20 * in_numclusters, subset);
+
+                std::cout << "compute_vocabulary: streaming clustering, init=" << in_init << std::endl;
+
+                typedef l2norm_squared<vec_f32_t> dist_fn;
+                kmeans<vec_vec_f32_t, dist_fn> initfn(subset, in_numclusters, initalgorithm, dist_fn(), in_numthreads);
+
+                StreamingKmeans clusterfn(matrix, initfn.centers(), in_numthreads);
+                clusterfn.run(in_maxiter, in_minchangesfraction);
+
+                std::cout << "compute_vocabulary: writing resulting centers to output file " << in_outputfile << std::endl;
+                write_property(clusterfn.centers(), in_outputfile);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "compute_vocabulary: streaming clustering failed: " << e.what() << std::endl;
+                return false;
+            }
+
+            return true;
+        }
+
         vec_vec_f32_t samples;
         if (has_sizefile && has_numsamples)
         {
@@ -217,13 +387,78 @@ public:
             }
         }
 
-        std::cout << "compute_vocabulary: clustering" << std::endl;
+        // the kmeans options apply to the flat vocabulary as well as to each node of a vocabulary tree
+        string in_algorithm = "lloyd";
+        _co_algorithm.parse_single<string>(args, in_algorithm);
+        if (in_algorithm != "lloyd" && in_algorithm != "hamerly")
+        {
+            std::cerr << "compute_vocabulary: unknown kmeans algorithm " << in_algorithm << std::endl;
+            return false;
+        }
+
+        int in_batchsize = 0;
+        if (_co_batchsize.parse_single<int>(args, in_batchsize) && in_batchsize < 1)
+        {
+            std::cerr << "compute_vocabulary: batchsize must be > 0" << std::endl;
+            return false;
+        }
+
+        int in_batchiter = 500;
+        _co_batchiter.parse_single<int>(args, in_batchiter);
+
+        int in_branching = 0;
+        if (_co_branching.parse_single<int>(args, in_branching))
+        {
+            if (in_branching < 2)
+            {
+                std::cerr << "compute_vocabulary: branching factor must be > 1" << std::endl;
+                return false;
+            }
+
+            // by default use the smallest depth that gives at least numclusters words
+            int in_depth = 1;
+            for (int words = in_branching; words < in_numclusters; words *= in_branching) in_depth++;
+            _co_depth.parse_single<int>(args, in_depth);
+
+            std::cout << "compute_vocabulary: building vocabulary tree, branching=" << in_branching << " depth=" << in_depth << " init=" << in_init;
+            if (in_batchsize > 0) std::cout << " batchsize=" << in_batchsize << " iterations=" << in_batchiter;
+            else std::cout << " algorithm=" << in_algorithm;
+            std::cout << std::endl;
+
+            VocabularyTree tree;
+            hierarchical_kmeans<l2norm_squared<vec_f32_t> >(samples, in_branching, in_depth, in_maxiter, in_minchangesfraction, in_numthreads, tree,
+                                                            initalgorithm, in_algorithm == "hamerly", in_batchsize, in_batchiter);
+
+            std::cout << "compute_vocabulary: writing vocabulary tree to output file " << in_outputfile << std::endl;
+
+            try { tree.save(in_outputfile); }
+            catch (const std::exception& e)
+            {
+                std::cerr << "compute_vocabulary: failed to write vocabulary tree: " << e.what() << std::endl;
+                return false;
+            }
+
+            return true;
+        }
+
+        std::cout << "compute_vocabulary: clustering, init=" << in_init << std::endl;
 
         // cluster the data
         vec_vec_f32_t centers;
-        typedef kmeans<vec_vec_f32_t, l2norm_squared<vec_f32_t> > cluster_fn;
-        cluster_fn clusterfn(samples, in_numclusters);
-        clusterfn.run(in_maxiter, in_minchangesfraction);
+        typedef l2norm_squared<vec_f32_t> dist_fn;
+        typedef kmeans<vec_vec_f32_t, dist_fn> cluster_fn;
+        cluster_fn clusterfn(samples, in_numclusters, initalgorithm, dist_fn(), in_numthreads);
+
+        if (in_batchsize > 0)
+        {
+            std::cout << "compute_vocabulary: mini-batch kmeans, batchsize=" << in_batchsize << " iterations=" << in_batchiter << std::endl;
+            clusterfn.run_minibatch(in_batchsize, in_batchiter);
+        }
+        else
+        {
+            clusterfn.set_accelerated(in_algorithm == "hamerly");
+            clusterfn.run(in_maxiter, in_minchangesfraction);
+        }
         centers = clusterfn.centers();
 
         // write the resulting cluster centers
@@ -249,6 +484,13 @@ private:
     CmdOption _co_numthreads;
     CmdOption _co_maxiter;
     CmdOption _co_minchangesfraction;
+    CmdOption _co_branching;
+    CmdOption _co_depth;
+    CmdOption _co_batchsize;
+    CmdOption _co_batchiter;
+    CmdOption _co_algorithm;
+    CmdOption _co_init;
+    CmdOption _co_matrixfile;
 };
 
 int main(int argc, char **argv)
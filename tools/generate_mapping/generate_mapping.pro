@@ -2,7 +2,7 @@ TARGET = generate_mapping
 TEMPLATE = app
 include(../../common.pri)
 
-LIBS += -lboost_filesystem-mt -lboost_system-mt
+LIBS += -lboost_filesystem-mt -lboost_system-mt -lboost_thread-mt
 
 CONFIG += console
 
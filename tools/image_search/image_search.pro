@@ -3,21 +3,31 @@ include(../../common.pri)
 
 CONFIG += console
 TEMPLATE = app
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -lgomp
+
+LIBS += -lboost_thread-mt
+
 LIBS += -lopencv_core \
         -lopencv_highgui \
         -lopencv_imgproc
 
 SOURCES += main.cpp \
 search/linear_search_manager.cpp \
+search/tensor_search_manager.cpp \
 search/bof_search_manager.cpp \
 search/inverted_index.cpp \
 search/tf_idf.cpp \
+search/top_k.cpp \
 descriptors/generator.cpp \
 descriptors/shog.cpp \
 descriptors/galif.cpp \
 descriptors/utilities.cpp \
 descriptors/image_sampler.cpp \
 io/filelist.cpp \
-util/quantizer.cpp
+util/quantizer.cpp \
+util/vocabulary_tree.cpp \
+util/kdforest.cpp \
+util/batch_quantizer.cpp
 
 HEADERS +=
@@ -14,13 +14,14 @@ the terms of the BSD license (see the LICENSE file).
 
 #include <util/types.hpp>
 #include <util/quantizer.hpp>
+#include <util/batch_quantizer.hpp>
 #include <io/property_reader.hpp>
 #include <io/cmdline.hpp>
 #include <io/filelist.hpp>
 #include <descriptors/generator.hpp>
-#include <search/linear_search.hpp>
 #include <search/bof_search_manager.hpp>
 #include <search/linear_search_manager.hpp>
+#include <search/tensor_search_manager.hpp>
 #include <search/distance.hpp>
 
 using namespace imdb;
@@ -49,6 +50,10 @@ public:
         , _co_generator_name("generatorname"  , "g", "name of generator [optional, if given, we will use generator's default parameters and ignore --generatorptree]")
         , _co_generator_ptree("generatorptree", "p", "filename of the JSON file containing generator name and parameters [optional, if not provided, generator's default values are used']")
         , _co_num_results  ("numresults"      , "n", "number of results to search for [optional, if not provided all distances get computed]")
+        , _co_quantization("quantization"     , "t", "quantization method {hard,fuzzyknn,tree,approx} [optional, default hard, only used with bag-of-features search, must match the method used in compute_histvw]")
+        , _co_sigma("sigma"                   , "w", "sigma for gaussian weighting [required with 'fuzzyknn' quantization only]")
+        , _co_knn("knn"                       , "k", "number of nearest words a descriptor is assigned to [optional, default 5, only used with 'fuzzyknn' quantization]")
+        , _co_checks("checks"                 , "c", "maximum number of words compared to each descriptor [optional, default 128, only used with 'approx' quantization]")
 
     {
         add(_co_query_image);
@@ -59,6 +64,10 @@ public:
         add(_co_generator_ptree);
         add(_co_num_results);
         add(_co_generator_name);
+        add(_co_quantization);
+        add(_co_sigma);
+        add(_co_knn);
+        add(_co_checks);
     }
 
 
@@ -79,6 +88,10 @@ public:
         string in_generatorptree;
         string in_generatorname;
         string in_vocabulary;
+        string in_quantization = "hard";
+        float  in_sigma;
+        size_t in_knn = 5;
+        size_t in_checks = 128;
 
         // this default value will make the search managers search
         // for all images if the user does not provide a value
@@ -180,18 +193,62 @@ public:
             }
 
 
-            vec_vec_f32_t vocabulary;
-            read_property(vocabulary, in_vocabulary);
+            _co_quantization.parse_single<string>(args, in_quantization);
+            _co_knn.parse_single<size_t>(args, in_knn);
+            _co_checks.parse_single<size_t>(args, in_checks);
 
             // quantize
-            quantize_fn quantizer = quantize_hard<vec_f32_t, imdb::l2norm_squared<vec_f32_t> >();
-            vec_vec_f32_t quantized_samples;
+            vec_vec_f32_t vocabulary;
+            quantize_index_fn quantizer;
 
-            const vec_vec_f32_t& samples = boost::any_cast<vec_vec_f32_t>(data["features"]);
-            quantize_samples_parallel(samples, vocabulary, quantized_samples, quantizer);
+            if (in_quantization == "hard")
+            {
+                read_property(vocabulary, in_vocabulary);
+            }
+            else if (in_quantization == "fuzzyknn")
+            {
+                if (!_co_sigma.parse_single<float>(args, in_sigma) || in_knn == 0)
+                {
+                    std::cerr << "image_search: 'fuzzyknn' quantization requires --sigma and a --knn of at least 1" << std::endl;
+                    print();
+                    return false;
+                }
+                read_property(vocabulary, in_vocabulary);
+            }
+            else if (in_quantization == "tree")
+            {
+                shared_ptr<VocabularyTree> tree = make_shared<VocabularyTree>();
+                tree->load(in_vocabulary);
+                tree->words(vocabulary);
+                quantizer = quantize_tree(tree);
+            }
+            else if (in_quantization == "approx")
+            {
+                read_property(vocabulary, in_vocabulary);
+                quantizer = quantize_approx(boost::make_shared<KdForest>(vocabulary), in_checks);
+            }
+            else
+            {
+                std::cerr << "image_search: quantization method can only be {'hard', 'fuzzyknn', 'tree', 'approx'}. You provided: '" << in_quantization << "'" << std::endl;
+                return false;
+            }
 
             vec_f32_t histvw;
-            build_histvw(quantized_samples, vocabulary.size(), histvw, false);
+
+            const vec_vec_f32_t& samples = boost::any_cast<vec_vec_f32_t>(data["features"]);
+            if (in_quantization == "fuzzyknn")
+            {
+                vector<sparse_quantized_t> sparse_samples;
+                BatchQuantizer(vocabulary).quantize_fuzzy_knn(samples, in_sigma, in_knn, sparse_samples);
+                build_histvw(sparse_samples, vocabulary.size(), histvw, true);
+            }
+            else
+            {
+                vector<uint32_t> words;
+                if (in_quantization == "hard") BatchQuantizer(vocabulary).quantize_hard(samples, words);
+                else quantize_samples_parallel(samples, words, quantizer);
+                build_histvw(words, vocabulary.size(), histvw, false);
+            }
 
             // initialize search manager and run query
             BofSearchManager bofSearch(search_params);
@@ -201,21 +258,15 @@ public:
         else if (search_params.get<std::string>("search_type") == "LinearSearch")
         {
             // Tensor descriptor is a bit of a special case as we additionally
-            // need to pass a 'mask' to the distance function, so we replicate
-            // most of the functionality implemented in LinearSearchManager
+            // need to pass a 'mask' to the distance function, this is handled
+            // by the specialized TensorSearchManager
             if (gen->parameters().get<string>("name") == "tensor")
             {
-                string filename = search_params.get<string>("descriptor_file");
-                vec_vec_f32_t features;
-                read_property(features, filename);
+                TensorSearchManager search(search_params);
 
                 const vec_f32_t& descr = get<vec_f32_t>(data, "features");
                 const vector<bool>& mask = get<vector<bool> >(data, "mask");
-                std::cout << "mask size=" << mask.size() << std::endl;
-                dist_frobenius<vec_f32_t> distfn;
-                distfn.mask = &mask;
-                linear_search(descr, features, results, in_numresults, distfn);
-
+                search.query(descr, mask, in_numresults, results);
             }
             else
             {
@@ -251,6 +302,10 @@ private:
     CmdOption _co_generator_name;
     CmdOption _co_generator_ptree;
     CmdOption _co_num_results;
+    CmdOption _co_quantization;
+    CmdOption _co_sigma;
+    CmdOption _co_knn;
+    CmdOption _co_checks;
 };
 
 
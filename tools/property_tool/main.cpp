@@ -0,0 +1,415 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+
+#include <util/types.hpp>
+#include <io/cmdline.hpp>
+#include <io/property_copy.hpp>
+#include <io/property_journal.hpp>
+#include <io/property_scanner.hpp>
+
+
+using namespace imdb;
+
+
+class command_info : public Command
+{
+public:
+
+    command_info()
+        : Command("info <property file>")
+    {}
+
+    bool run(const std::vector<std::string>& args)
+    {
+        if (args.size() == 0)
+        {
+            print();
+            return false;
+        }
+
+        const std::string& filename = args[0];
+
+        PropertyIndex index;
+        bool incomplete = false;
+        try
+        {
+            incomplete = read_property_journal(filename, index);
+            if (!incomplete) read_property_index(filename, index);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        std::cout << "file:        " << filename << (incomplete ? " (incomplete, state of the last checkpoint)" : "") << std::endl;
+        std::cout << "elements:    " << index.offsets.size() << std::endl;
+        std::cout << "contiguous:  " << index.prefix_size() << std::endl;
+        std::cout << "data bytes:  " << index.dataend << std::endl;
+        if (index.compressed()) std::cout << "blocks:      " << index.blockpos.size() << " (" << index.rawend << " bytes uncompressed)" << std::endl;
+
+        for (strmap_t::const_iterator it = index.map.begin(); it != index.map.end(); ++it)
+        {
+            std::cout << it->first << " = " << it->second << std::endl;
+        }
+
+        return true;
+    }
+};
+
+class command_recover : public Command
+{
+public:
+
+    command_recover()
+        : Command("recover <property file>\n"
+                  "completes a property file whose writer died, keeping the elements up to the last checkpoint of its journal")
+    {}
+
+    bool run(const std::vector<std::string>& args)
+    {
+        if (args.size() == 0)
+        {
+            print();
+            return false;
+        }
+
+        const std::string& filename = args[0];
+
+        try
+        {
+            index_t size = recover_property(filename);
+            std::cout << "property_tool: recovered " << size << " elements of file " << filename << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+};
+
+
+// Compression of the output: that of the input unless given by --compression and --shuffle
+bool parse_compression(CmdOption& co_compression, CmdOption& co_shuffle, const std::vector<std::string>& args, const RawPropertyReader& input, PropertyCompression& compression)
+{
+    compression = compression_of(input);
+
+    std::string codec;
+    if (co_compression.parse_single<std::string>(args, codec))
+    {
+        try { compression.codec = PropertyCompression::codec_from_name(codec); }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    co_shuffle.parse_single<std::size_t>(args, compression.shuffle);
+    return true;
+}
+
+class command_merge : public Command
+{
+public:
+
+    command_merge()
+        : Command("merge [options]\n"
+                  "concatenates property files of the same type, e.g. computed on disjoint ranges of a filelist")
+        , _co_input      ("input"      , "i", "property files to merge, in this order [required]")
+        , _co_output     ("output"     , "o", "merged property file [required]")
+        , _co_compression("compression", "c", "compression of the output: none, lz4 or zstd [optional] (default: that of the first input)")
+        , _co_shuffle    ("shuffle"    , "s", "shuffle the bytes of words of this size before compression [optional] (default: that of the first input)")
+    {
+        add(_co_input);
+        add(_co_output);
+        add(_co_compression);
+        add(_co_shuffle);
+    }
+
+    bool run(const std::vector<std::string>& args)
+    {
+        warn_for_unknown_option(args);
+
+        std::vector<std::string> in_inputs;
+        std::string in_output;
+        if (!_co_input.parse_multiple<std::string>(args, in_inputs) || !_co_output.parse_single<std::string>(args, in_output))
+        {
+            print();
+            return false;
+        }
+
+        try
+        {
+            boost::shared_ptr<PropertyCopier> copier;
+            for (size_t i = 0; i < in_inputs.size(); i++)
+            {
+                RawPropertyReader input(in_inputs[i]);
+                if (!copier)
+                {
+                    PropertyCompression compression;
+                    if (!parse_compression(_co_compression, _co_shuffle, args, input, compression)) return false;
+                    copier = boost::make_shared<PropertyCopier>(in_output, compression);
+                }
+
+                copier->append(input);
+                std::cout << "property_tool: appended " << input.size() << " elements of " << in_inputs[i] << std::endl;
+            }
+            std::cout << "property_tool: wrote " << copier->size() << " elements to " << in_output << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    CmdOption _co_input;
+    CmdOption _co_output;
+    CmdOption _co_compression;
+    CmdOption _co_shuffle;
+};
+
+class command_split : public Command
+{
+public:
+
+    command_split()
+        : Command("split [options]\n"
+                  "splits a property file into parts of (almost) equal numbers of elements, named <output>0, <output>1, ...")
+        , _co_input      ("input"      , "i", "property file to split [required]")
+        , _co_output     ("output"     , "o", "output prefix [required]")
+        , _co_parts      ("parts"      , "p", "number of parts [required]")
+        , _co_compression("compression", "c", "compression of the parts: none, lz4 or zstd [optional] (default: that of the input)")
+        , _co_shuffle    ("shuffle"    , "s", "shuffle the bytes of words of this size before compression [optional] (default: that of the input)")
+    {
+        add(_co_input);
+        add(_co_output);
+        add(_co_parts);
+        add(_co_compression);
+        add(_co_shuffle);
+    }
+
+    bool run(const std::vector<std::string>& args)
+    {
+        warn_for_unknown_option(args);
+
+        std::string in_input;
+        std::string in_output;
+        index_t in_parts = 0;
+        if (!_co_input.parse_single<std::string>(args, in_input)
+                || !_co_output.parse_single<std::string>(args, in_output)
+                || !_co_parts.parse_single<index_t>(args, in_parts))
+        {
+            print();
+            return false;
+        }
+
+        if (in_parts < 1)
+        {
+            std::cerr << "property_tool: number of parts should be > 0" << std::endl;
+            return false;
+        }
+
+        try
+        {
+            RawPropertyReader input(in_input);
+            PropertyCompression compression;
+            if (!parse_compression(_co_compression, _co_shuffle, args, input, compression)) return false;
+
+            for (index_t k = 0; k < in_parts; k++)
+            {
+                index_t begin = input.size() * k / in_parts;
+                index_t end = input.size() * (k + 1) / in_parts;
+                std::string filename = in_output + boost::lexical_cast<std::string>(k);
+
+                PropertyCopier copier(filename, compression);
+                copier.append(input, begin, end);
+                std::cout << "property_tool: wrote elements [" << begin << ", " << end << ") to " << filename << std::endl;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    CmdOption _co_input;
+    CmdOption _co_output;
+    CmdOption _co_parts;
+    CmdOption _co_compression;
+    CmdOption _co_shuffle;
+};
+
+class command_dense : public Command
+{
+public:
+
+    command_dense()
+        : Command("dense [options]\n"
+                  "converts a property file of global descriptors (vec_f32_t) of fixed dimension into a dense file")
+        , _co_input      ("input"      , "i", "property file to convert [required]")
+        , _co_output     ("output"     , "o", "dense property file [required]")
+    {
+        add(_co_input);
+        add(_co_output);
+    }
+
+    bool run(const std::vector<std::string>& args)
+    {
+        warn_for_unknown_option(args);
+
+        std::string in_input;
+        std::string in_output;
+        if (!_co_input.parse_single<std::string>(args, in_input) || !_co_output.parse_single<std::string>(args, in_output))
+        {
+            print();
+            return false;
+        }
+
+        try
+        {
+            PropertyReaderT<vec_f32_t> input(in_input);
+            PropertyScannerT<vec_f32_t> scanner(input, 1024);
+            PropertyWriterT<vec_f32_t> output;
+            output.open_dense(in_output);
+
+            vec_f32_t row;
+            while (scanner.next(row)) output.push_back(row);
+            std::cout << "property_tool: wrote " << output.size() << " rows of dimension " << row.size() << " to " << in_output << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    CmdOption _co_input;
+    CmdOption _co_output;
+};
+
+class command_slice : public Command
+{
+public:
+
+    command_slice()
+        : Command("slice [options]\n"
+                  "copies the elements [begin, end) of a property file into a new one")
+        , _co_input      ("input"      , "i", "property file to slice [required]")
+        , _co_output     ("output"     , "o", "output property file [required]")
+        , _co_begin      ("begin"      , "b", "index of the first element [optional] (default: 0)")
+        , _co_end        ("end"        , "e", "index behind the last element [optional] (default: number of elements)")
+        , _co_compression("compression", "c", "compression of the output: none, lz4 or zstd [optional] (default: that of the input)")
+        , _co_shuffle    ("shuffle"    , "s", "shuffle the bytes of words of this size before compression [optional] (default: that of the input)")
+    {
+        add(_co_input);
+        add(_co_output);
+        add(_co_begin);
+        add(_co_end);
+        add(_co_compression);
+        add(_co_shuffle);
+    }
+
+    bool run(const std::vector<std::string>& args)
+    {
+        warn_for_unknown_option(args);
+
+        std::string in_input;
+        std::string in_output;
+        if (!_co_input.parse_single<std::string>(args, in_input) || !_co_output.parse_single<std::string>(args, in_output))
+        {
+            print();
+            return false;
+        }
+
+        try
+        {
+            RawPropertyReader input(in_input);
+            PropertyCompression compression;
+            if (!parse_compression(_co_compression, _co_shuffle, args, input, compression)) return false;
+
+            index_t in_begin = 0;
+            index_t in_end = input.size();
+            _co_begin.parse_single<index_t>(args, in_begin);
+            _co_end.parse_single<index_t>(args, in_end);
+
+            PropertyCopier copier(in_output, compression);
+            copier.append(input, in_begin, in_end);
+            std::cout << "property_tool: wrote elements [" << in_begin << ", " << in_end << ") to " << in_output << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "property_tool: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    CmdOption _co_input;
+    CmdOption _co_output;
+    CmdOption _co_begin;
+    CmdOption _co_end;
+    CmdOption _co_compression;
+    CmdOption _co_shuffle;
+};
+
+
+int main(int argc, char *argv[])
+{
+    typedef std::map<std::string, std::pair<boost::shared_ptr<Command>, std::string> > cmd_map_t;
+    cmd_map_t cmd_desc;
+    cmd_desc["dense"]   = std::make_pair(boost::make_shared<command_dense>()  , "convert global descriptors into a dense property file");
+    cmd_desc["info"]    = std::make_pair(boost::make_shared<command_info>()   , "print the index of a (possibly incomplete) property file");
+    cmd_desc["merge"]   = std::make_pair(boost::make_shared<command_merge>()  , "concatenate property files");
+    cmd_desc["recover"] = std::make_pair(boost::make_shared<command_recover>(), "make an incomplete property file readable using its journal");
+    cmd_desc["slice"]   = std::make_pair(boost::make_shared<command_slice>()  , "copy a range of elements into a new property file");
+    cmd_desc["split"]   = std::make_pair(boost::make_shared<command_split>()  , "split a property file into equally sized parts");
+
+    if (argc <= 1 || !cmd_desc.count(argv[1]))
+    {
+        std::cout << "usage: " << (argc > 0 ? argv[0]:"property_tool") << " <command> ..." << std::endl;
+        std::cout << " commands:" << std::endl;
+
+        const int c0 = 20;
+        cmd_map_t::const_iterator it;
+        for (it = cmd_desc.begin(); it != cmd_desc.end(); ++it)
+        {
+            std::cout << " * " << it->first;
+            for (int k = 0; k < c0 - (int)it->first.length(); k++) std::cout << ' ';
+            std::cout << " : " << it->second.second << std::endl;
+        }
+
+        return 1;
+    }
+    return cmd_desc[argv[1]].first->run(argv_to_strings(argc-2, &argv[2])) ? 0:1;
+}
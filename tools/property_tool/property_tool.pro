@@ -0,0 +1,16 @@
+TARGET = property_tool
+TEMPLATE = app
+include(../../common.pri)
+
+LIBS += -lboost_thread-mt
+
+CONFIG += console
+
+SOURCES += main.cpp
+
+HEADERS += util/types.hpp \
+    io/property_copy.hpp \
+    io/property_journal.hpp \
+    io/property_reader.hpp \
+    io/property_writer.hpp \
+    io/cmdline.hpp
@@ -5,4 +5,5 @@ compute_descriptors \
 compute_vocabulary \
 compute_histvw \
 compute_index \
-image_search
+image_search \
+property_tool
@@ -0,0 +1,327 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "batch_quantizer.hpp"
+
+namespace imdb {
+
+namespace
+{
+
+// The kernel computes the dot products of a tile of rows_per_tile samples
+// and panel_width words at a time, this keeps all accumulators in registers
+const size_t rows_per_tile = 4;
+const size_t panel_width = 8;
+
+// number of samples processed against each panel before moving to the next one,
+// i.e. a block of samples has to fit into the L2 cache
+const size_t rows_per_block = 64;
+
+// dots[r][j] = <rows[r], word j of the panel>
+inline void kernel_4x8(const float* const rows[rows_per_tile], const float* panel, size_t dim, float dots[rows_per_tile][panel_width])
+{
+#ifdef __SSE2__
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+
+    for (size_t k = 0; k < dim; k++, panel += panel_width)
+    {
+        __m128 b0 = _mm_loadu_ps(panel);
+        __m128 b1 = _mm_loadu_ps(panel + 4);
+
+        __m128 a = _mm_set1_ps(rows[0][k]);
+        c00 = _mm_add_ps(c00, _mm_mul_ps(a, b0));
+        c01 = _mm_add_ps(c01, _mm_mul_ps(a, b1));
+
+        a = _mm_set1_ps(rows[1][k]);
+        c10 = _mm_add_ps(c10, _mm_mul_ps(a, b0));
+        c11 = _mm_add_ps(c11, _mm_mul_ps(a, b1));
+
+        a = _mm_set1_ps(rows[2][k]);
+        c20 = _mm_add_ps(c20, _mm_mul_ps(a, b0));
+        c21 = _mm_add_ps(c21, _mm_mul_ps(a, b1));
+
+        a = _mm_set1_ps(rows[3][k]);
+        c30 = _mm_add_ps(c30, _mm_mul_ps(a, b0));
+        c31 = _mm_add_ps(c31, _mm_mul_ps(a, b1));
+    }
+
+    _mm_storeu_ps(dots[0], c00); _mm_storeu_ps(dots[0] + 4, c01);
+    _mm_storeu_ps(dots[1], c10); _mm_storeu_ps(dots[1] + 4, c11);
+    _mm_storeu_ps(dots[2], c20); _mm_storeu_ps(dots[2] + 4, c21);
+    _mm_storeu_ps(dots[3], c30); _mm_storeu_ps(dots[3] + 4, c31);
+#else
+    for (size_t r = 0; r < rows_per_tile; r++)
+    {
+        std::fill(dots[r], dots[r] + panel_width, 0.0f);
+    }
+
+    for (size_t k = 0; k < dim; k++, panel += panel_width)
+    {
+        for (size_t r = 0; r < rows_per_tile; r++)
+        {
+            float a = rows[r][k];
+            for (size_t j = 0; j < panel_width; j++) dots[r][j] += a * panel[j];
+        }
+    }
+#endif
+}
+
+inline float norm_squared(const vec_f32_t& v)
+{
+    float sum = 0;
+    for (size_t i = 0; i < v.size(); i++) sum += v[i]*v[i];
+    return sum;
+}
+
+} // anonymous namespace
+
+
+// Keeps track of the closest word of each sample
+struct BatchQuantizer::argmin_sink
+{
+    argmin_sink(size_t numSamples)
+        : _dist(numSamples, std::numeric_limits<float>::max())
+        , _word(numSamples, 0)
+    {}
+
+    void operator()(size_t sample, size_t word, float dist)
+    {
+        // <= to resolve ties the same way as quantize_hard
+        if (dist <= _dist[sample])
+        {
+            _dist[sample] = dist;
+            _word[sample] = static_cast<uint32_t>(word);
+        }
+    }
+
+    vec_f32_t        _dist;
+    vector<uint32_t> _word;
+};
+
+// Writes the Gaussian weight of each (sample, word) pair into the quantized samples
+struct BatchQuantizer::gaussian_sink
+{
+    gaussian_sink(vec_vec_f32_t& quantized, float sigma) : _quantized(quantized), _sigma2(2*sigma*sigma) {}
+
+    void operator()(size_t sample, size_t word, float dist)
+    {
+        // dist is the squared distance, as returned by l2norm_squared in quantize_fuzzy
+        _quantized[sample][word] = std::exp(-dist*dist / _sigma2);
+    }
+
+    vec_vec_f32_t& _quantized;
+    float          _sigma2;
+};
+
+// Keeps the k closest words of each sample in a bounded max-heap
+struct BatchQuantizer::knn_sink
+{
+    knn_sink(size_t numSamples, size_t k) : _heaps(numSamples), _k(k)
+    {
+        for (size_t i = 0; i < numSamples; i++) _heaps[i].reserve(k);
+    }
+
+    void operator()(size_t sample, size_t word, float dist)
+    {
+        vector<dist_idx_f32_t>& heap = _heaps[sample];
+        if (heap.size() < _k)
+        {
+            heap.push_back(dist_idx_f32_t(dist, static_cast<uint32_t>(word)));
+            std::push_heap(heap.begin(), heap.end());
+        }
+        else if (dist < heap.front().first)
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = dist_idx_f32_t(dist, static_cast<uint32_t>(word));
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    vector<vector<dist_idx_f32_t> > _heaps;
+    size_t _k;
+};
+
+
+BatchQuantizer::BatchQuantizer(const vec_vec_f32_t& vocabulary)
+    : _numWords(vocabulary.size())
+    , _numPanels((vocabulary.size() + panel_width - 1) / panel_width)
+    , _dim(vocabulary.empty() ? 0 : vocabulary[0].size())
+{
+    _packed.assign(_numPanels * _dim * panel_width, 0.0f);
+    _norms.assign(_numPanels * panel_width, 0.0f);
+
+    for (size_t i = 0; i < _numWords; i++)
+    {
+        assert(vocabulary[i].size() == _dim);
+
+        size_t p = i / panel_width;
+        size_t j = i % panel_width;
+        for (size_t k = 0; k < _dim; k++) _packed[(p*_dim + k)*panel_width + j] = vocabulary[i][k];
+
+        _norms[i] = norm_squared(vocabulary[i]);
+    }
+}
+
+
+template <class sink_t>
+void BatchQuantizer::run(const vec_vec_f32_t& samples, sink_t& sink) const
+{
+    const size_t numSamples = samples.size();
+    const size_t numBlocks = (numSamples + rows_per_block - 1) / rows_per_block;
+
+    vec_f32_t sampleNorms(numSamples);
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        assert(samples[i].size() == _dim);
+        sampleNorms[i] = norm_squared(samples[i]);
+    }
+
+    // each block only touches its own samples in the sink, so blocks are independent
+    #pragma omp parallel for schedule(dynamic)
+    for (long b = 0; b < static_cast<long>(numBlocks); b++)
+    {
+        size_t blockBegin = b * rows_per_block;
+        size_t blockEnd = std::min(blockBegin + rows_per_block, numSamples);
+
+        float dots[rows_per_tile][panel_width];
+
+        for (size_t p = 0; p < _numPanels; p++)
+        {
+            const float* panel = &_packed[p*_dim*panel_width];
+            size_t wordBegin = p * panel_width;
+            size_t wordEnd = std::min(wordBegin + panel_width, _numWords);
+
+            for (size_t tile = blockBegin; tile < blockEnd; tile += rows_per_tile)
+            {
+                // a partial tile at the end of the block repeats its last sample
+                // the results for these rows are simply ignored
+                size_t tileEnd = std::min(tile + rows_per_tile, blockEnd);
+                const float* rows[rows_per_tile];
+                for (size_t r = 0; r < rows_per_tile; r++) rows[r] = &samples[std::min(tile + r, tileEnd - 1)][0];
+
+                kernel_4x8(rows, panel, _dim, dots);
+
+                for (size_t i = tile; i < tileEnd; i++)
+                {
+                    for (size_t w = wordBegin; w < wordEnd; w++)
+                    {
+                        // the expansion may become slightly negative due to rounding
+                        float dist = sampleNorms[i] + _norms[w] - 2*dots[i - tile][w - wordBegin];
+                        sink(i, w, std::max(dist, 0.0f));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void BatchQuantizer::quantize_hard(const vec_vec_f32_t& samples, vector<uint32_t>& words) const
+{
+    words.assign(samples.size(), 0);
+    if (samples.empty() || _numWords == 0) return;
+
+    argmin_sink sink(samples.size());
+    run(samples, sink);
+    words.swap(sink._word);
+}
+
+
+void BatchQuantizer::quantize_hard(const vec_vec_f32_t& samples, vec_vec_f32_t& quantized_samples) const
+{
+    vector<uint32_t> words;
+    quantize_hard(samples, words);
+
+    quantized_samples.resize(samples.size());
+    if (_numWords == 0) return;
+
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        quantized_samples[i].assign(_numWords, 0.0f);
+        quantized_samples[i][words[i]] = 1;
+    }
+}
+
+
+void BatchQuantizer::quantize_fuzzy(const vec_vec_f32_t& samples, float sigma, vec_vec_f32_t& quantized_samples) const
+{
+    assert(sigma > 0);
+
+    quantized_samples.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) quantized_samples[i].resize(_numWords);
+    if (samples.empty() || _numWords == 0) return;
+
+    gaussian_sink sink(quantized_samples, sigma);
+    run(samples, sink);
+
+    // normalize such that each sample contributes the same amount of
+    // energy to the histogram, see quantize_fuzzy
+    #pragma omp parallel for
+    for (long i = 0; i < static_cast<long>(samples.size()); i++)
+    {
+        vec_f32_t& q = quantized_samples[i];
+
+        float sum = 0;
+        for (size_t w = 0; w < _numWords; w++) sum += q[w];
+        for (size_t w = 0; w < _numWords; w++) q[w] /= sum;
+    }
+}
+
+void BatchQuantizer::quantize_fuzzy_knn(const vec_vec_f32_t& samples, float sigma, size_t k, vector<sparse_quantized_t>& quantized_samples) const
+{
+    assert(sigma > 0);
+    assert(k > 0);
+
+    quantized_samples.resize(samples.size());
+    if (samples.empty() || _numWords == 0) return;
+
+    knn_sink sink(samples.size(), std::min(k, _numWords));
+    run(samples, sink);
+
+    float sigma2 = 2*sigma*sigma;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        vector<dist_idx_f32_t>& heap = sink._heaps[i];
+        std::sort_heap(heap.begin(), heap.end());
+
+        sparse_quantized_t& q = quantized_samples[i];
+        q.resize(heap.size());
+
+        float sum = 0;
+        for (size_t j = 0; j < heap.size(); j++)
+        {
+            float d = heap[j].first;
+            q[j] = std::make_pair(heap[j].second, std::exp(-d*d / sigma2));
+            sum += q[j].second;
+        }
+
+        if (sum > 0)
+        {
+            for (size_t j = 0; j < q.size(); j++) q[j].second /= sum;
+        }
+        else
+        {
+            q.resize(1);
+            q[0].second = 1;
+        }
+    }
+}
+
+} // namespace imdb
@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef BATCH_QUANTIZER_HPP
+#define BATCH_QUANTIZER_HPP
+
+#include "types.hpp"
+#include "quantizer.hpp"
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Quantizes all local features of an image at once against a fixed vocabulary.
+ *
+ * Gives the same results as quantize_hard and quantize_fuzzy with the l2norm_squared distance, but instead
+ * of comparing one (sample, word) pair at a time all squared distances are computed using the expansion
+ * ||a - b||^2 = ||a||^2 + ||b||^2 - 2ab. The dot products form a matrix product of the samples and the
+ * vocabulary which is computed by a cache-blocked kernel: the vocabulary is packed into panels of a few words
+ * with interleaved dimensions (such that a panel stays in the L1 cache while a block of samples is streamed
+ * against it) and the norms of all words are precomputed. Blocks of samples are processed in parallel using OpenMP.
+ *
+ * Due to the expansion, distances of nearly identical vectors are subject to cancellation, i.e. for samples that are
+ * (almost) equally close to two words hard quantization may pick a different word than quantize_hard.
+ *
+ * All methods are const and may be called concurrently.
+ */
+class BatchQuantizer
+{
+    public:
+
+    /// Packs the vocabulary, all words must have the same dimension
+    explicit BatchQuantizer(const vec_vec_f32_t& vocabulary);
+
+    /**
+     * @brief Hard quantization, same result as quantize_samples_parallel() with quantize_hard.
+     * @param quantized_samples One vector per sample the size of the vocabulary, containing a single 1 at the index of the closest word
+     */
+    void quantize_hard(const vec_vec_f32_t& samples, vec_vec_f32_t& quantized_samples) const;
+
+    /**
+     * @brief Hard quantization returning word indices, use with the build_histvw() overload for word indices.
+     * @param words Index of the closest word of each sample, same size as \p samples
+     */
+    void quantize_hard(const vec_vec_f32_t& samples, vector<uint32_t>& words) const;
+
+    /**
+     * @brief Fuzzy quantization, same result as quantize_samples_parallel() with quantize_fuzzy.
+     * @param sigma Standard deviation of the Gaussian used for weighting a sample
+     * @param quantized_samples One vector per sample the size of the vocabulary, containing the normalized Gaussian weights
+     */
+    void quantize_fuzzy(const vec_vec_f32_t& samples, float sigma, vec_vec_f32_t& quantized_samples) const;
+
+    /**
+     * @brief Fuzzy quantization truncated to the k nearest words of each sample.
+     *
+     * Only the (exact) k nearest words of a sample receive a Gaussian weight, the weights are normalized to
+     * sum up to one over these k words. Should all k weights underflow, the nearest word gets weight 1.
+     * Use build_histvw() for sparse samples to accumulate the result.
+     *
+     * @param sigma Standard deviation of the Gaussian used for weighting a sample
+     * @param k Number of nearest words kept per sample
+     * @param quantized_samples One sparse vector per sample, sorted by ascending distance of the words
+     */
+    void quantize_fuzzy_knn(const vec_vec_f32_t& samples, float sigma, size_t k, vector<sparse_quantized_t>& quantized_samples) const;
+
+    size_t size() const { return _numWords; }
+    size_t dim() const { return _dim; }
+
+    private:
+
+    struct argmin_sink;
+    struct gaussian_sink;
+    struct knn_sink;
+
+    template <class sink_t>
+    void run(const vec_vec_f32_t& samples, sink_t& sink) const;
+
+    // _packed contains the vocabulary in panels of panel_width words. Within a panel, the
+    // values of dimension k of all its words are stored next to each other, i.e. word j
+    // of panel p, dimension k is at _packed[(p*_dim + k)*panel_width + j]. The last panel is
+    // padded with zero words
+    vec_f32_t _packed;
+
+    // squared L2 norm of each word, padded like _packed
+    vec_f32_t _norms;
+
+    size_t _numWords;
+    size_t _numPanels;
+    size_t _dim;
+};
+
+} // namespace imdb
+
+#endif // BATCH_QUANTIZER_HPP
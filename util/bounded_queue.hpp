@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <cassert>
+#include <deque>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief FIFO queue of limited capacity connecting producer and consumer threads.
+ *
+ * push() blocks while the queue is full, pop() blocks while it is empty. Once the producer(s)
+ * are done they call close(), from then on pop() returns the remaining elements and false
+ * afterwards, such that the consumers can terminate. The capacity bounds the memory used by
+ * elements that have been produced (e.g. read from disk) but not yet consumed.
+ */
+template <class T>
+class BoundedQueue
+{
+    public:
+
+    explicit BoundedQueue(std::size_t capacity) : _capacity(capacity), _closed(false)
+    {
+        assert(_capacity > 0);
+    }
+
+    /// Appends element, blocks while the queue is full. Returns false (and drops
+    /// element) if the queue has been closed.
+    bool push(const T& element)
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        while (_queue.size() >= _capacity && !_closed) _notFull.wait(lock);
+        if (_closed) return false;
+
+        _queue.push_back(element);
+        _notEmpty.notify_one();
+        return true;
+    }
+
+    /// Removes the first element, blocks while the queue is empty. Returns false
+    /// if the queue is empty and has been closed.
+    bool pop(T& element)
+    {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        while (_queue.empty() && !_closed) _notEmpty.wait(lock);
+        if (_queue.empty()) return false;
+
+        element = _queue.front();
+        _queue.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    /// No more elements will be pushed, wakes up all waiting threads.
+    void close()
+    {
+        boost::lock_guard<boost::mutex> lock(_mutex);
+        _closed = true;
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+    private:
+
+    std::deque<T> _queue;
+    std::size_t   _capacity;
+    bool          _closed;
+
+    boost::mutex              _mutex;
+    boost::condition_variable _notEmpty;
+    boost::condition_variable _notFull;
+};
+
+} // namespace imdb
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,193 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef HIERARCHICAL_KMEANS_HPP
+#define HIERARCHICAL_KMEANS_HPP
+
+#include <vector>
+#include <iostream>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "kmeans.hpp"
+#include "vocabulary_tree.hpp"
+
+
+namespace hkm_detail {
+
+// A node of the vocabulary tree that still needs to be split, together with
+// the indices of all samples that ended up in this node
+struct hkm_task
+{
+    int32_t                  node;
+    std::vector<std::size_t> members;
+};
+
+// Result of clustering a single task: the centers of its children and for
+// each child the indices of its member samples
+struct hkm_result
+{
+    imdb::vec_vec_f32_t                    centers;
+    std::vector<std::vector<std::size_t> > members;
+};
+
+// How the kmeans of each node is run
+struct hkm_params
+{
+    std::size_t         branching;
+    std::size_t         maxiteration;
+    double              minchangesfraction;
+    KmeansInitAlgorithm initalgorithm;
+    bool                accelerated;
+    std::size_t         batchsize;
+    std::size_t         batchiterations;
+};
+
+template <class dist_fn>
+void hkm_cluster_tasks(const imdb::vec_vec_f32_t& samples, const std::vector<hkm_task>& tasks, std::vector<hkm_result>& results,
+                       const hkm_params& params, std::size_t numthreads, std::size_t& index, boost::mutex& mutex)
+{
+    for (;;)
+    {
+        std::size_t t;
+
+        {
+            boost::lock_guard<boost::mutex> locker(mutex);
+            if (index == tasks.size()) break;
+            t = index++;
+        }
+
+        const std::vector<std::size_t>& members = tasks[t].members;
+
+        // nodes with too few samples are not split any further, they become leaves
+        if (members.size() <= params.branching) continue;
+
+        imdb::vec_vec_f32_t subset(members.size());
+        for (std::size_t i = 0; i < members.size(); i++) subset[i] = samples[members[i]];
+
+        kmeans<imdb::vec_vec_f32_t, dist_fn> clusterfn(subset, params.branching, params.initalgorithm, dist_fn(), numthreads);
+        clusterfn.set_verbose(tasks.size() == 1);
+
+        // mini-batches only pay off for nodes with many more samples than a batch
+        if (params.batchsize > 0 && members.size() > params.batchsize)
+        {
+            clusterfn.run_minibatch(params.batchsize, params.batchiterations);
+        }
+        else
+        {
+            clusterfn.set_accelerated(params.accelerated);
+            clusterfn.run(params.maxiteration, params.minchangesfraction);
+        }
+
+        hkm_result& r = results[t];
+        r.centers = clusterfn.centers();
+        clusterfn.make_cluster_table(r.members);
+
+        // map indices into subset back to indices into samples
+        for (std::size_t c = 0; c < r.members.size(); c++)
+        {
+            for (std::size_t i = 0; i < r.members[c].size(); i++) r.members[c][i] = members[r.members[c][i]];
+        }
+    }
+}
+
+} // namespace hkm_detail
+
+
+/**
+ * @ingroup util
+ * @brief Builds a imdb::VocabularyTree using hierarchical k-means clustering.
+ *
+ * The samples are clustered into \p branching clusters using the standard kmeans, the samples of
+ * each cluster are then recursively clustered again until the tree has reached \p depth levels
+ * (or a node contains no more than \p branching samples). This results in at most branching^depth words.
+ *
+ * The tree is built level by level. The root is clustered using \p numthreads threads, on all further
+ * levels the nodes are clustered in parallel (\p numthreads nodes at a time, each using a single thread).
+ * The layout of the resulting tree is independent of the number of threads.
+ *
+ * @param samples Samples to cluster
+ * @param branching Branching factor b of the tree, i.e. number of children of each inner node
+ * @param depth Number of levels below the root
+ * @param maxiteration kmeans stopping criterion, see kmeans::run()
+ * @param minchangesfraction kmeans stopping criterion, see kmeans::run()
+ * @param numthreads Number of threads to use
+ * @param tree Resulting tree, any previous content is replaced
+ * @param initalgorithm Initialization of the kmeans of each node
+ * @param accelerated Use the accelerated kmeans for each node, see kmeans::set_accelerated()
+ * @param batchsize If > 0, nodes with more samples than this are clustered with mini-batch kmeans, see kmeans::run_minibatch()
+ * @param batchiterations Maximum number of mini-batch iterations
+ */
+template <class dist_fn>
+void hierarchical_kmeans(const imdb::vec_vec_f32_t& samples, std::size_t branching, std::size_t depth, std::size_t maxiteration, double minchangesfraction, std::size_t numthreads, imdb::VocabularyTree& tree,
+                         KmeansInitAlgorithm initalgorithm = KmeansInitRandom, bool accelerated = false, std::size_t batchsize = 0, std::size_t batchiterations = 500)
+{
+    using hkm_detail::hkm_task;
+    using hkm_detail::hkm_result;
+
+    assert(branching > 1);
+    numthreads = std::max<std::size_t>(numthreads, 1);
+
+    tree.clear(samples.empty() ? 0 : samples[0].size());
+
+    hkm_detail::hkm_params params = { branching, maxiteration, minchangesfraction, initalgorithm, accelerated, batchsize, batchiterations };
+
+    std::vector<hkm_task> level(1);
+    level[0].node = 0;
+    level[0].members.resize(samples.size());
+    for (std::size_t i = 0; i < samples.size(); i++) level[0].members[i] = i;
+
+    for (std::size_t d = 0; d < depth && !level.empty(); d++)
+    {
+        std::cout << "hierarchical_kmeans: level " << d << ", clustering " << level.size() << " nodes" << std::endl;
+
+        std::vector<hkm_result> results(level.size());
+
+        // the root level is a single large problem, there we parallelize
+        // inside kmeans, all other levels are parallelized over the nodes
+        std::size_t nodethreads = (level.size() == 1) ? 1 : numthreads;
+        std::size_t kmeansthreads = (level.size() == 1) ? numthreads : 1;
+
+        boost::thread_group pool;
+        std::size_t index = 0;
+        boost::mutex mtx;
+        for (std::size_t i = 0; i < nodethreads; i++)
+        {
+            pool.create_thread(boost::bind(&hkm_detail::hkm_cluster_tasks<dist_fn>, boost::cref(samples), boost::cref(level), boost::ref(results),
+                                           boost::cref(params), kmeansthreads, boost::ref(index), boost::ref(mtx)));
+        }
+        pool.join_all();
+
+        // append children in the order of the tasks, this
+        // makes the layout of the tree deterministic
+        std::vector<hkm_task> next;
+        for (std::size_t t = 0; t < level.size(); t++)
+        {
+            hkm_result& r = results[t];
+            if (r.centers.empty()) continue;
+
+            int32_t first = tree.add_children(level[t].node, r.centers);
+            for (std::size_t c = 0; c < r.centers.size(); c++)
+            {
+                next.push_back(hkm_task());
+                next.back().node = first + static_cast<int32_t>(c);
+                next.back().members.swap(r.members[c]);
+            }
+        }
+
+        level.swap(next);
+    }
+
+    tree.finalize();
+
+    std::cout << "hierarchical_kmeans: tree contains " << tree.num_nodes() << " nodes and " << tree.num_words() << " words" << std::endl;
+}
+
+#endif // HIERARCHICAL_KMEANS_HPP
@@ -0,0 +1,144 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef HISTVW_BUILDER_HPP
+#define HISTVW_BUILDER_HPP
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/make_shared.hpp>
+
+#include "types.hpp"
+#include "quantizer.hpp"
+#include "batch_quantizer.hpp"
+#include "../io/property_reader.hpp"
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Quantizes the samples of a single image and builds its histogram of visual words including all spatial
+ * pyramid levels.
+ *
+ * Shared by compute_histvw, which reads the samples from property files, and the fused indexing pipeline of
+ * compute_descriptors, which gets them directly from the generator. Set quantization, pyramidlevels, knn and sigma,
+ * then call load() once; afterwards operator() may be called concurrently.
+ */
+struct histvw_builder
+{
+    string                           quantization;
+    shared_ptr<const BatchQuantizer> batch;     // hard, fuzzy and fuzzyknn
+    quantize_index_fn                quantizer; // tree and approx
+    size_t                           vocabularySize;
+    size_t                           pyramidlevels;
+    size_t                           knn;
+    float                            sigma;
+    bool                             normalize;
+
+    histvw_builder()
+        : vocabularySize(0)
+        , pyramidlevels(1)
+        , knn(5)
+        , sigma(0)
+        , normalize(false)
+    {}
+
+    /**
+     * @brief Loads the vocabulary and prepares the quantizer for the quantization method.
+     *
+     * With 'tree' quantization the vocabulary file contains a VocabularyTree, its leaves make up the (flat) vocabulary.
+     * @param checks Maximum number of words compared to each sample, only used with 'approx' quantization
+     * @return Description of the quantization for progress output, e.g. "hard clustering"
+     * @throw std::runtime_error if the quantization method is unknown or the vocabulary cannot be read
+     */
+    std::string load(const std::string& vocabulary_file, size_t checks)
+    {
+        vec_vec_f32_t vocabulary;
+        shared_ptr<VocabularyTree> tree;
+
+        if (quantization == "tree")
+        {
+            tree = boost::make_shared<VocabularyTree>();
+            tree->load(vocabulary_file);
+            tree->words(vocabulary);
+        }
+        else
+        {
+            read_property(vocabulary, vocabulary_file);
+        }
+
+        vocabularySize = vocabulary.size();
+
+        // hard and fuzzy quantization of all samples of an image are done at once by
+        // the BatchQuantizer, tree and approx use a per-sample quantization function
+        std::ostringstream description;
+        if (quantization == "fuzzy")
+        {
+            description << "fuzzy clustering, sigma=" << sigma;
+            batch = boost::make_shared<BatchQuantizer>(vocabulary);
+            normalize = true;
+        }
+        else if (quantization == "fuzzyknn")
+        {
+            description << "fuzzy clustering of the " << knn << " nearest words, sigma=" << sigma;
+            batch = boost::make_shared<BatchQuantizer>(vocabulary);
+            normalize = true;
+        }
+        else if (quantization == "hard")
+        {
+            description << "hard clustering";
+            batch = boost::make_shared<BatchQuantizer>(vocabulary);
+            normalize = false;
+        }
+        else if (quantization == "tree")
+        {
+            description << "vocabulary tree, #words=" << tree->num_words();
+            quantizer = quantize_tree(tree);
+            normalize = false;
+        }
+        else if (quantization == "approx")
+        {
+            description << "approximate hard clustering, checks=" << checks;
+            quantizer = quantize_approx(boost::make_shared<KdForest>(vocabulary), checks);
+            normalize = false;
+        }
+        else
+        {
+            throw std::runtime_error("unknown quantization method: " + quantization);
+        }
+
+        return description.str();
+    }
+
+    void operator()(const vec_vec_f32_t& samples, const vec_vec_f32_t& positions, vec_f32_t& hist) const
+    {
+        // quantize all samples of the image, the result has the same size as the samples vector,
+        // i.e. one quantized sample for each original sample. Hard quantization only yields the
+        // index of a sample's word, with 'fuzzyknn' quantization each sample only contributes to its
+        // nearest words, these are kept as sparse (word, weight) pairs. Only 'fuzzy' needs a
+        // vocabulary-sized vector per sample.
+        vector<uint32_t> words;
+        vec_vec_f32_t quantized_samples;
+        vector<sparse_quantized_t> sparse_samples;
+        if (quantization == "hard") batch->quantize_hard(samples, words);
+        else if (quantization == "fuzzy") batch->quantize_fuzzy(samples, sigma, quantized_samples);
+        else if (quantization == "fuzzyknn") batch->quantize_fuzzy_knn(samples, sigma, knn, sparse_samples);
+        else quantize_samples_parallel(samples, words, quantizer);
+
+        // all spatial pyramid levels are built in a single pass
+        if (quantization == "fuzzy") build_pyramid_histvw(quantized_samples, vocabularySize, hist, normalize, positions, pyramidlevels);
+        else if (quantization == "fuzzyknn") build_pyramid_histvw(sparse_samples, vocabularySize, hist, normalize, positions, pyramidlevels);
+        else build_pyramid_histvw(words, vocabularySize, hist, normalize, positions, pyramidlevels);
+    }
+};
+
+} // namespace imdb
+
+#endif // HISTVW_BUILDER_HPP
@@ -0,0 +1,325 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "kdforest.hpp"
+
+namespace imdb {
+
+namespace
+{
+
+// number of randomly chosen points used to estimate mean and variance when splitting a node
+const size_t num_samples_mean = 100;
+
+// the splitting dimension is chosen randomly among this number of dimensions with highest variance
+const size_t num_random_dims = 5;
+
+
+// orders the indices of a node by the value of the points in a single dimension
+struct less_in_dim
+{
+    less_in_dim(const float* points, size_t dim, size_t d) : _points(points), _dim(dim), _d(d) {}
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return _points[a*_dim + _d] < _points[b*_dim + _d];
+    }
+
+    const float* _points;
+    size_t _dim;
+    size_t _d;
+};
+
+// true for all indices whose point lies below split in dimension d
+struct below_split
+{
+    below_split(const float* points, size_t dim, size_t d, float split) : _points(points), _dim(dim), _d(d), _split(split) {}
+
+    bool operator()(uint32_t a) const
+    {
+        return _points[a*_dim + _d] < _split;
+    }
+
+    const float* _points;
+    size_t _dim;
+    size_t _d;
+    float  _split;
+};
+
+// Marks of the points compared to the query by the searches of a thread. A point has been compared in the
+// current search iff its stamp equals the number of the search, such that the marks need not be cleared
+struct visited_t
+{
+    visited_t() : epoch(0) {}
+
+    void next_search(size_t numPoints)
+    {
+        if (stamps.size() < numPoints || ++epoch == 0)
+        {
+            stamps.assign(std::max(stamps.size(), numPoints), 0);
+            epoch = 1;
+        }
+    }
+
+    vector<uint32_t> stamps;
+    uint32_t         epoch;
+};
+
+visited_t& thread_visited()
+{
+    static boost::thread_specific_ptr<visited_t> visited;
+    if (!visited.get()) visited.reset(new visited_t());
+    return *visited;
+}
+
+} // anonymous namespace
+
+
+// State of a single best-bin-first query over all trees of the forest
+struct kdforest_search
+{
+    // a branch not taken while descending: lower bound of the distance between
+    // the query and all points in that branch
+    struct branch_t
+    {
+        float   mindist;
+        int32_t tree;
+        int32_t node;
+
+        // reversed such that the priority_queue returns the closest branch first
+        bool operator<(const branch_t& other) const { return mindist > other.mindist; }
+    };
+
+    kdforest_search(const KdForest& forest, const vec_f32_t& query, size_t k, size_t checks)
+        : _forest(forest), _query(&query[0]), _k(k), _checks(checks), _numChecks(0), _visited(thread_visited())
+    {
+        _best.reserve(k + 1);
+        _visited.next_search(forest._numPoints);
+    }
+
+    bool full() const { return _best.size() == _k; }
+    float worst() const { return _best.front().first; }
+
+    void run(vector<dist_idx_f32_t>& result)
+    {
+        for (size_t t = 0; t < _forest._trees.size(); t++) descend(t, 0, 0);
+
+        while (!_branches.empty() && (_numChecks < _checks || !full()))
+        {
+            branch_t b = _branches.top();
+            _branches.pop();
+
+            // all remaining branches are even farther away
+            if (full() && b.mindist >= worst()) break;
+
+            descend(b.tree, b.node, b.mindist);
+        }
+
+        std::sort_heap(_best.begin(), _best.end());
+        result.swap(_best);
+    }
+
+    void descend(int32_t t, int32_t n, float mindist)
+    {
+        const KdForest::tree_t& tree = _forest._trees[t];
+        const KdForest::node_t* node = &tree.nodes[n];
+
+        while (node->dim >= 0)
+        {
+            float diff = _query[node->dim] - node->split;
+            int32_t near = (diff < 0) ? node->child[0] : node->child[1];
+            int32_t far  = (diff < 0) ? node->child[1] : node->child[0];
+
+            branch_t b = {mindist + diff*diff, t, far};
+            if (!full() || b.mindist < worst()) _branches.push(b);
+
+            node = &tree.nodes[near];
+        }
+
+        if (_numChecks >= _checks && full()) return;
+
+        const size_t dim = _forest._dim;
+        for (int32_t i = node->child[0]; i < node->child[1]; i++)
+        {
+            uint32_t index = tree.indices[i];
+
+            // the same point is contained in every tree, only compare it once
+            if (_visited.stamps[index] == _visited.epoch) continue;
+            _visited.stamps[index] = _visited.epoch;
+            _numChecks++;
+
+            const float* p = &_forest._points[index*dim];
+            float dist = 0;
+            for (size_t j = 0; j < dim; j++)
+            {
+                float d = _query[j] - p[j];
+                dist += d*d;
+            }
+
+            if (!full())
+            {
+                _best.push_back(dist_idx_f32_t(dist, index));
+                std::push_heap(_best.begin(), _best.end());
+            }
+            else if (dist < worst())
+            {
+                std::pop_heap(_best.begin(), _best.end());
+                _best.back() = dist_idx_f32_t(dist, index);
+                std::push_heap(_best.begin(), _best.end());
+            }
+        }
+    }
+
+    const KdForest& _forest;
+    const float*    _query;
+    size_t          _k;
+    size_t          _checks;
+    size_t          _numChecks;
+
+    std::priority_queue<branch_t> _branches;
+
+    // max-heap of the best points found so far
+    vector<dist_idx_f32_t> _best;
+
+    // the points compared so far
+    visited_t& _visited;
+};
+
+
+KdForest::KdForest(const vec_vec_f32_t& points, size_t numtrees, size_t checks)
+    : _numPoints(points.size())
+    , _dim(points.empty() ? 0 : points[0].size())
+    , _checks(checks)
+{
+    assert(numtrees > 0);
+
+    _points.reserve(_numPoints * _dim);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        assert(points[i].size() == _dim);
+        _points.insert(_points.end(), points[i].begin(), points[i].end());
+    }
+
+    if (_numPoints == 0) return;
+
+    // fixed seed, such that the forest is the same for every run
+    boost::mt19937 rng;
+
+    _trees.resize(numtrees);
+    for (size_t t = 0; t < numtrees; t++)
+    {
+        tree_t& tree = _trees[t];
+        tree.indices.resize(_numPoints);
+        for (size_t i = 0; i < _numPoints; i++) tree.indices[i] = static_cast<uint32_t>(i);
+        tree.nodes.reserve(2*_numPoints);
+        build(tree, 0, static_cast<uint32_t>(_numPoints), rng);
+    }
+}
+
+
+int32_t KdForest::build(tree_t& tree, uint32_t begin, uint32_t end, boost::mt19937& rng)
+{
+    int32_t n = static_cast<int32_t>(tree.nodes.size());
+    node_t leaf = {{static_cast<int32_t>(begin), static_cast<int32_t>(end)}, -1, 0};
+    tree.nodes.push_back(leaf);
+
+    if (end - begin <= 1) return n;
+
+    // estimate mean and variance of each dimension from a random sample of the points of this node,
+    // small nodes use all of their points
+    vector<uint32_t> samples;
+    if (end - begin <= num_samples_mean)
+    {
+        samples.assign(tree.indices.begin() + begin, tree.indices.begin() + end);
+    }
+    else
+    {
+        boost::variate_generator<boost::mt19937&, boost::uniform_int<uint32_t> > randpoint(rng, boost::uniform_int<uint32_t>(begin, end - 1));
+        for (size_t i = 0; i < num_samples_mean; i++) samples.push_back(tree.indices[randpoint()]);
+    }
+
+    vector<double> mean(_dim, 0.0), var(_dim, 0.0);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        const float* p = &_points[samples[i]*_dim];
+        for (size_t j = 0; j < _dim; j++) mean[j] += p[j];
+    }
+    for (size_t j = 0; j < _dim; j++) mean[j] /= samples.size();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        const float* p = &_points[samples[i]*_dim];
+        for (size_t j = 0; j < _dim; j++) var[j] += (p[j] - mean[j])*(p[j] - mean[j]);
+    }
+
+    // randomly choose one of the dimensions with highest variance
+    vector<pair<double, size_t> > order(_dim);
+    for (size_t j = 0; j < _dim; j++) order[j] = make_pair(-var[j], j);
+    size_t numcandidates = std::min(num_random_dims, _dim);
+    std::partial_sort(order.begin(), order.begin() + numcandidates, order.end());
+
+    boost::variate_generator<boost::mt19937&, boost::uniform_int<size_t> > randdim(rng, boost::uniform_int<size_t>(0, numcandidates - 1));
+    size_t d = order[randdim()].second;
+
+    // split at the mean
+    float split = static_cast<float>(mean[d]);
+    uint32_t* indices = &tree.indices[0];
+    uint32_t mid = static_cast<uint32_t>(std::partition(indices + begin, indices + end, below_split(&_points[0], _dim, d, split)) - indices);
+
+    // degenerate split, e.g. because all points of the node are equal
+    // in dimension d: split at the median position instead
+    if (mid == begin || mid == end)
+    {
+        mid = begin + (end - begin) / 2;
+        std::nth_element(indices + begin, indices + mid, indices + end, less_in_dim(&_points[0], _dim, d));
+        split = _points[tree.indices[mid]*_dim + d];
+    }
+
+    int32_t left = build(tree, begin, mid, rng);
+    int32_t right = build(tree, mid, end, rng);
+
+    // do not hold a reference across the recursive calls,
+    // the node vector might have been reallocated
+    node_t& node = tree.nodes[n];
+    node.child[0] = left;
+    node.child[1] = right;
+    node.dim = static_cast<int32_t>(d);
+    node.split = split;
+
+    return n;
+}
+
+
+void KdForest::search(const vec_f32_t& query, size_t k, vector<dist_idx_f32_t>& result, size_t checks) const
+{
+    assert(query.size() == _dim);
+
+    result.clear();
+    if (_numPoints == 0 || k == 0) return;
+
+    kdforest_search s(*this, query, std::min(k, _numPoints), checks > 0 ? checks : _checks);
+    s.run(result);
+}
+
+
+uint32_t KdForest::nearest(const vec_f32_t& query, size_t checks) const
+{
+    vector<dist_idx_f32_t> result;
+    search(query, 1, result, checks);
+    assert(result.size() == 1);
+    return result[0].second;
+}
+
+} // namespace imdb
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef KDFOREST_HPP
+#define KDFOREST_HPP
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include "types.hpp"
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Approximate nearest neighbor search using a forest of randomized k-d trees.
+ *
+ * Follows the approach of Silpa-Anan & Hartley (Optimised KD-trees for fast image descriptor matching)
+ * as implemented in FLANN (Muja & Lowe): each tree splits at the mean of a dimension that is randomly chosen
+ * among the dimensions of highest variance. All trees are searched simultaneously in best-bin-first order
+ * using a single priority queue. The search stops as soon as \p checks points have been compared to the
+ * query, this budget trades accuracy for speed.
+ *
+ * Distances are squared L2 distances. The forest keeps a copy of the points, all queries are const
+ * and may be performed concurrently from several threads.
+ */
+class KdForest
+{
+    public:
+
+    /**
+     * @brief Builds the forest over points.
+     * @param points Points to search in, all of the same dimension (typically a vocabulary)
+     * @param numtrees Number of randomized trees
+     * @param checks Default maximum number of points compared to the query in search()
+     */
+    KdForest(const vec_vec_f32_t& points, size_t numtrees = 4, size_t checks = 128);
+
+    /**
+     * @brief Approximate k nearest neighbors of query.
+     * @param result The (at most) k nearest points found, sorted by ascending squared L2 distance. Any previous content is cleared.
+     * @param checks Maximum number of points compared to the query, 0 uses the default passed to the constructor
+     */
+    void search(const vec_f32_t& query, size_t k, vector<dist_idx_f32_t>& result, size_t checks = 0) const;
+
+    /// Index of the approximate nearest neighbor of query
+    uint32_t nearest(const vec_f32_t& query, size_t checks = 0) const;
+
+    size_t size() const { return _numPoints; }
+    size_t dim() const { return _dim; }
+
+    private:
+
+    struct node_t
+    {
+        // inner node: children, leaf: child[0] = begin, child[1] = end into the index array of the tree
+        int32_t child[2];
+
+        // splitting dimension, -1 for a leaf
+        int32_t dim;
+        float   split;
+    };
+
+    struct tree_t
+    {
+        vector<node_t>  nodes;
+        vector<uint32_t> indices;
+    };
+
+    int32_t build(tree_t& tree, uint32_t begin, uint32_t end, boost::mt19937& rng);
+
+    friend struct kdforest_search;
+
+    vector<tree_t> _trees;
+
+    // all points stored one after the other
+    vec_f32_t _points;
+    size_t    _numPoints;
+    size_t    _dim;
+    size_t    _checks;
+};
+
+} // namespace imdb
+
+#endif // KDFOREST_HPP
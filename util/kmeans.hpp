@@ -13,30 +13,56 @@ the terms of the BSD license (see the LICENSE file).
 #include <algorithm>
 #include <iostream>
 #include <set>
+#include <numeric>
+#include <limits>
+#include <cmath>
 
 #include <boost/random.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/locks.hpp>
 
 #include <QTime>
 
 #include "../search/distance.hpp"
 #include "kmeans_init.hpp"
+#include "thread_pool.hpp"
 
 
 
+/**
+ * @brief Maps the result of a distance function to a metric, i.e. a distance satisfying the triangle inequality.
+ *
+ * Required by the accelerated kmeans (see kmeans::set_accelerated()). By default, the distance function is
+ * assumed to be a metric itself (e.g. l1norm, l2norm), specialize this for other distance functions whose
+ * result can be turned into a metric by a monotonic mapping.
+ */
+template <class dist_fn>
+struct kmeans_metric
+{
+    static double apply(double d) { return d; }
+};
+
+/// The squared L2 distance is turned into the L2 distance
+template <class T, class R>
+struct kmeans_metric<imdb::l2norm_squared<T, R> >
+{
+    static double apply(double d) { return std::sqrt(d); }
+};
+
+
 /**
  * @brief Standard kmeans clustering
  */
 template <class collection_t, class dist_fn>
 class kmeans
 {
-    typedef boost::mutex               mutex_t;
-    typedef boost::lock_guard<mutex_t> locker_t;
-
     typedef typename collection_t::value_type sample_t;
 
+    // work is handed out to the threads in chunks of this many samples resp. centers
+    static const std::size_t samples_per_chunk = 64;
+    static const std::size_t centers_per_chunk = 8;
+
     public:
 
     /**
@@ -46,15 +72,21 @@ class kmeans
      * @param numclusters Number of clusters to use.
      * @param initalgorithm Algorithm used to estimate the inital cluster centers
      * @param distfn Distance function used for comparing two samples.
+     * @param numthreads Number of threads, for the initialization as well as the clustering (see set_num_threads()), 0 uses the number of processors
      */
-    kmeans(const collection_t& collection, std::size_t numclusters, KmeansInitAlgorithm initalgorithm = KmeansInitRandom, const dist_fn& distfn = dist_fn())
+    kmeans(const collection_t& collection, std::size_t numclusters, KmeansInitAlgorithm initalgorithm = KmeansInitRandom, const dist_fn& distfn = dist_fn(), std::size_t numthreads = 0)
      : _collection(collection), _distfn(distfn), _centers(numclusters), _clusters(collection.size())
+     , _numthreads(numthreads > 0 ? numthreads : std::max(boost::thread::hardware_concurrency(), 1u)), _verbose(true), _accelerated(false)
     {
         // get initial centers
         std::vector<std::size_t> initindices;
         if (initalgorithm == KmeansInitPlusPlus)
         {
-            kmeans_init_plusplus(initindices, collection, numclusters, distfn);
+            kmeans_init_plusplus(initindices, collection, numclusters, _distfn, _numthreads);
+        }
+        else if (initalgorithm == KmeansInitParallel)
+        {
+            kmeans_init_parallel(initindices, collection, numclusters, _distfn, _numthreads);
         }
         else
         {
@@ -75,8 +107,6 @@ class kmeans
      */
     void run(std::size_t maxiteration, double minchangesfraction)
     {
-        using namespace boost;
-
         // main iteration
         std::size_t iteration = 0;
         for (;;)
@@ -85,36 +115,24 @@ class kmeans
 
             QTime time;
             time.start();
-            std::size_t changes = 0;
 
             // distribute items on clusters in parallel
-            thread_group pool;
-            std::size_t idx = 0;
-            mutex_t mtx;
-            for (std::size_t i = 0; i < thread::hardware_concurrency(); i++)
-            {
-                pool.create_thread(bind(&kmeans::distribute_samples, this, ref(idx), ref(changes), ref(mtx)));
-            }
-            pool.join_all();
+            std::size_t changes = _accelerated ? distribute_bounded(iteration == 0) : distribute();
 
             iteration++;
 
-            std::cout << "changes: " << changes << " distribution time: " << time.elapsed() << std::endl;
+            if (_verbose) std::cout << "changes: " << changes << " distribution time: " << time.elapsed() << std::endl;
 
             if (changes <= std::ceil(_collection.size() * minchangesfraction)) break;
 
-            // compute new centers
-            std::vector<std::size_t> clustersize(_centers.size(), 0);
-            for (std::size_t i = 0; i < _collection.size(); i++)
-            {
-                std::size_t k = _clusters[i];
-
-                // if it is the first assignment for that cluster, then zero the center
-                if (clustersize[k] == 0) std::fill(_centers[k].begin(), _centers[k].end(), 0);
+            // the accelerated version needs to know how far each center moves
+            std::vector<sample_t> oldcenters;
+            std::vector<std::size_t> reassigned;
+            if (_accelerated) oldcenters = _centers;
 
-                add_operation(_centers[k], _collection[i]);
-                clustersize[k]++;
-            }
+            // compute new centers in parallel
+            std::vector<std::size_t> clustersize;
+            update_centers(clustersize);
 
             // assign new centers
             std::vector<std::size_t> invalid, valid;
@@ -122,7 +140,6 @@ class kmeans
             {
                 if (clustersize[i] > 0)
                 {
-                    div_operation(_centers[i], clustersize[i]);
                     valid.push_back(i);
                 }
                 else
@@ -136,7 +153,7 @@ class kmeans
             while (!invalid.empty() && !valid.empty())
             {
                 std::size_t current = invalid.back();
-std::cout << "handle invalid clusters: " << invalid.size() << std::endl;
+if (_verbose) std::cout << "handle invalid clusters: " << invalid.size() << std::endl;
                 // compute for each valid cluster the variance
                 // of distances to all members and get the
                 // most distant member
@@ -169,17 +186,120 @@ std::cout << "handle invalid clusters: " << invalid.size() << std::endl;
                 std::size_t c = std::distance(variance.begin(), std::max_element(variance.begin(), variance.end()));
                 _centers[current] = _collection[farthest[c]];
                 _clusters[farthest[c]] = current;
+                reassigned.push_back(farthest[c]);
 
-std::cout << "reassign " << current << " to sample " << farthest[c] << " of cluster " << c << std::endl;
+if (_verbose) std::cout << "reassign " << current << " to sample " << farthest[c] << " of cluster " << c << std::endl;
 
                 valid.pop_back();
                 invalid.pop_back();
             }
 
-std::cout << "iteration " << iteration << " time: " << time.elapsed() << std::endl;
+            if (_accelerated) update_bounds(oldcenters, reassigned);
+
+if (_verbose) std::cout << "iteration " << iteration << " time: " << time.elapsed() << std::endl;
         }
 
-std::cout << "kmeans iterations: " << iteration << std::endl;
+if (_verbose) std::cout << "kmeans iterations: " << iteration << std::endl;
+    }
+
+
+    /**
+     * @brief Perform mini-batch k-means clustering (Sculley - Web-Scale K-Means Clustering)
+     *
+     * Instead of assigning all samples in every iteration, each iteration only assigns a random batch of
+     * \p batchsize samples to their nearest centers. Every center is then moved towards each of its new members
+     * with a per-center learning rate of 1/n, where n is the number of samples assigned to that center so far.
+     *
+     * A random subset of the samples (of size batchsize, at most 10% of all samples) is held out from training.
+     * Every few iterations the mean distance of these samples to their nearest center is evaluated, clustering
+     * stops once it has not improved for \p patience evaluations in a row or after \p maxiteration iterations.
+     * Finally all samples are assigned to their nearest center, i.e. clusters() is valid afterwards.
+     *
+     * @param batchsize Number of samples per iteration
+     * @param maxiteration Maximum number of iterations (batches)
+     * @param patience Number of evaluations on the held-out samples without improvement before stopping, 0 disables early stopping
+     */
+    void run_minibatch(std::size_t batchsize, std::size_t maxiteration, std::size_t patience = 3)
+    {
+        assert(batchsize > 0);
+
+        // evaluate the held-out samples every this many iterations
+        const std::size_t evalinterval = 10;
+
+        // relative decrease of the held-out distance that counts as an improvement
+        const double minimprovement = 1e-3;
+
+        boost::mt19937 rng;
+
+        std::vector<std::size_t> indices(_collection.size());
+        for (std::size_t i = 0; i < indices.size(); i++) indices[i] = i;
+        random_index gen(rng);
+        std::random_shuffle(indices.begin(), indices.end(), gen);
+
+        // first part of the shuffled indices is held out, the rest is used for training
+        std::size_t numheldout = std::min(batchsize, _collection.size() / 10);
+        std::vector<std::size_t> heldout(indices.begin(), indices.begin() + numheldout);
+        indices.erase(indices.begin(), indices.begin() + numheldout);
+        if (indices.empty()) return;
+
+        boost::uniform_int<std::size_t> uniform(0, indices.size() - 1);
+        boost::variate_generator<boost::mt19937&, boost::uniform_int<std::size_t> > randindex(rng, uniform);
+
+        std::vector<std::size_t> counts(_centers.size(), 0);
+        std::vector<std::size_t> batch(batchsize);
+        std::vector<std::size_t> nearest;
+        std::vector<double> dists;
+
+        double bestheldout = std::numeric_limits<double>::max();
+        std::size_t noimprovement = 0;
+
+        std::size_t iteration = 0;
+        while (iteration < maxiteration)
+        {
+            QTime time;
+            time.start();
+
+            for (std::size_t i = 0; i < batchsize; i++) batch[i] = indices[randindex()];
+
+            // assign the batch using the centers of the previous iteration, then update
+            assign(batch, nearest, dists);
+            for (std::size_t i = 0; i < batchsize; i++)
+            {
+                std::size_t c = nearest[i];
+                counts[c]++;
+
+                double eta = 1.0 / counts[c];
+                sample_t& center = _centers[c];
+                const sample_t& x = _collection[batch[i]];
+                for (std::size_t j = 0; j < center.size(); j++) center[j] = (1.0 - eta) * center[j] + eta * x[j];
+            }
+
+            iteration++;
+
+            if (numheldout > 0 && (iteration % evalinterval == 0 || iteration == maxiteration))
+            {
+                assign(heldout, nearest, dists);
+                double mean = std::accumulate(dists.begin(), dists.end(), 0.0) / numheldout;
+
+                if (mean < bestheldout * (1.0 - minimprovement))
+                {
+                    bestheldout = mean;
+                    noimprovement = 0;
+                }
+                else
+                {
+                    noimprovement++;
+                }
+
+                if (_verbose) std::cout << "mini-batch iteration " << iteration << " held-out mean distance: " << mean << " time: " << time.elapsed() << std::endl;
+
+                if (patience > 0 && noimprovement >= patience) break;
+            }
+        }
+
+        if (_verbose) std::cout << "mini-batch kmeans iterations: " << iteration << ", assigning all samples" << std::endl;
+
+        distribute();
     }
 
 
@@ -190,6 +310,37 @@ std::cout << "kmeans iterations: " << iteration << std::endl;
         this->run(std::numeric_limits<std::size_t>::max(), 0.01);
     }
 
+    /// Number of threads used for distributing the samples onto the clusters and
+    /// computing the centers, defaults to the number of processors
+    void set_num_threads(std::size_t numthreads)
+    {
+        _numthreads = std::max<std::size_t>(numthreads, 1);
+    }
+
+    /**
+     * @brief Enable/disable the accelerated version of run(), disabled by default.
+     *
+     * Uses Hamerly's algorithm (Making k-means even faster): for each sample an upper bound on the distance to its
+     * center and a lower bound on the distance to all other centers are maintained across iterations, together
+     * with half the distance of each center to its closest other center. A sample whose upper bound is below
+     * both of these is skipped, otherwise the bound is tightened and only if that does not suffice the sample is
+     * compared to all centers. Late in the clustering almost all samples are skipped.
+     *
+     * The resulting assignments are identical to the standard version. The bounds are based on the triangle
+     * inequality and thus require the distance function to be a metric after applying kmeans_metric<dist_fn>,
+     * e.g. l1norm, l2norm or l2norm_squared. Costs two doubles of memory per sample.
+     */
+    void set_accelerated(bool accelerated)
+    {
+        _accelerated = accelerated;
+    }
+
+    /// Enable/disable progress output on std::cout, enabled by default
+    void set_verbose(bool verbose)
+    {
+        _verbose = verbose;
+    }
+
     /// Vector of cluster membership: clusters[i] = j means that the sample with index i
     /// is a member of cluster j
     const std::vector<std::size_t>& clusters() const
@@ -227,53 +378,283 @@ std::cout << "kmeans iterations: " << iteration << std::endl;
 
     private:
 
-    void distribute_samples(std::size_t& index, std::size_t& changes, mutex_t& mutex)
+    // adapts a random number generator to std::random_shuffle
+    struct random_index
     {
-        std::vector<double> dists(_centers.size());
-        std::size_t currentchanges = 0;
+        random_index(boost::mt19937& rng) : _rng(rng) {}
+        std::ptrdiff_t operator()(std::ptrdiff_t n) { return boost::uniform_int<std::ptrdiff_t>(0, n - 1)(_rng); }
+        boost::mt19937& _rng;
+    };
 
-        for (;;)
+    // index of the center closest to sample and its distance
+    std::size_t nearest_center(const sample_t& sample, double& mindist) const
+    {
+        std::size_t best = 0;
+        mindist = std::numeric_limits<double>::max();
+        for (std::size_t c = 0; c < _centers.size(); c++)
+        {
+            double d = _distfn(sample, _centers[c]);
+            if (d < mindist)
+            {
+                mindist = d;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    // nearest center (and the distance to it) of the samples with the given indices, computed in parallel
+    void assign(const std::vector<std::size_t>& indices, std::vector<std::size_t>& nearest, std::vector<double>& dists)
+    {
+        nearest.resize(indices.size());
+        dists.resize(indices.size());
+
+        run_chunked(indices.size(), samples_per_chunk, boost::bind(&kmeans::assign_range, this, boost::cref(indices), _1, _2, boost::ref(nearest), boost::ref(dists)));
+    }
+
+    void assign_range(const std::vector<std::size_t>& indices, std::size_t begin, std::size_t end, std::vector<std::size_t>& nearest, std::vector<double>& dists) const
+    {
+        for (std::size_t i = begin; i < end; i++) nearest[i] = nearest_center(_collection[indices[i]], dists[i]);
+    }
+
+    // assigns all samples to their nearest center, returns the number of samples that changed their cluster
+    std::size_t distribute()
+    {
+        _threadchanges.assign(pool().size(), 0);
+        run_chunked(_collection.size(), samples_per_chunk, boost::bind(&kmeans::distribute_samples, this, _1, _2, _3));
+        return std::accumulate(_threadchanges.begin(), _threadchanges.end(), std::size_t(0));
+    }
+
+    void distribute_samples(std::size_t begin, std::size_t end, std::size_t thread)
+    {
+        // each sample belongs to exactly one chunk, so the
+        // cluster membership can be updated without locking
+        std::size_t changes = 0;
+        for (std::size_t i = begin; i < end; i++)
+        {
+            double mindist;
+            std::size_t c = nearest_center(_collection[i], mindist);
+            if (_clusters[i] != c)
+            {
+                _clusters[i] = c;
+                changes++;
+            }
+        }
+
+        _threadchanges[thread] += changes;
+    }
+
+    // recomputes all centers as the mean of their members and returns the number of members
+    // of each cluster. The centers of empty clusters are left unchanged
+    void update_centers(std::vector<std::size_t>& clustersize)
+    {
+        // sort the sample indices by cluster (counting sort), each center is then computed by
+        // a single thread from its members in ascending order, such that the result does
+        // not depend on the number of threads
+        clustersize.assign(_centers.size(), 0);
+        for (std::size_t i = 0; i < _clusters.size(); i++) clustersize[_clusters[i]]++;
+
+        _memberoffsets.resize(_centers.size() + 1);
+        _memberoffsets[0] = 0;
+        for (std::size_t c = 0; c < _centers.size(); c++) _memberoffsets[c + 1] = _memberoffsets[c] + clustersize[c];
+
+        std::vector<std::size_t> position(_memberoffsets.begin(), _memberoffsets.end() - 1);
+        _members.resize(_clusters.size());
+        for (std::size_t i = 0; i < _clusters.size(); i++) _members[position[_clusters[i]]++] = i;
+
+        run_chunked(_centers.size(), centers_per_chunk, boost::bind(&kmeans::compute_centers, this, _1, _2));
+    }
+
+    void compute_centers(std::size_t begin, std::size_t end)
+    {
+        for (std::size_t c = begin; c < end; c++)
         {
-            std::size_t i;
+            std::size_t first = _memberoffsets[c];
+            std::size_t last = _memberoffsets[c + 1];
+            if (first == last) continue;
+
+            sample_t& center = _centers[c];
+            std::fill(center.begin(), center.end(), 0);
+            for (std::size_t m = first; m < last; m++) add_operation(center, _collection[_members[m]]);
+            div_operation(center, last - first);
+        }
+    }
 
+    // metric distance between a and b
+    double metric(const sample_t& a, const sample_t& b) const
+    {
+        return kmeans_metric<dist_fn>::apply(_distfn(a, b));
+    }
+
+    // Hamerly's assignment step, on the first call (init = true) all samples are compared
+    // to all centers to initialize the bounds. Returns the number of changed assignments
+    std::size_t distribute_bounded(bool init)
+    {
+        if (init)
+        {
+            _upper.assign(_collection.size(), 0);
+            _lower.assign(_collection.size(), 0);
+        }
+
+        // half the distance of each center to its closest other center
+        _halfmin.assign(_centers.size(), std::numeric_limits<double>::max());
+        run_chunked(_centers.size(), centers_per_chunk, boost::bind(&kmeans::center_distances, this, _1, _2));
+
+        _threadchanges.assign(pool().size(), 0);
+        run_chunked(_collection.size(), samples_per_chunk, boost::bind(&kmeans::distribute_bounded_range, this, init, _1, _2, _3));
+
+        return std::accumulate(_threadchanges.begin(), _threadchanges.end(), std::size_t(0));
+    }
+
+    void center_distances(std::size_t begin, std::size_t end)
+    {
+        for (std::size_t c = begin; c < end; c++)
+        {
+            for (std::size_t k = 0; k < _centers.size(); k++)
             {
-                locker_t locker(mutex);
-                if (index == _collection.size()) break;
-                i = index++;
+                if (k != c) _halfmin[c] = std::min(_halfmin[c], 0.5 * metric(_centers[c], _centers[k]));
             }
+        }
+    }
 
-            // compute distance of current point to every center
-            std::transform(_centers.begin(), _centers.end(), dists.begin(), boost::bind(_distfn, boost::ref(_collection[i]), boost::arg<1>()));
+    void distribute_bounded_range(bool init, std::size_t begin, std::size_t end, std::size_t thread)
+    {
+        // the bounds are subject to rounding errors, only skip a sample if they clearly suffice
+        const double slack = 1e-5;
 
-            // find the minimum distance, i.e. the nearest center
-            std::size_t c = std::distance(dists.begin(), std::min_element(dists.begin(), dists.end()));
+        std::size_t changes = 0;
+        for (std::size_t i = begin; i < end; i++)
+        {
+            const sample_t& x = _collection[i];
 
-            // update cluster membership
+            if (!init)
             {
-                locker_t locker(_mutex);
+                double m = std::max(_halfmin[_clusters[i]], _lower[i]) * (1.0 - slack);
+                if (_upper[i] < m) continue;
 
-                if (_clusters[i] != c)
+                _upper[i] = metric(x, _centers[_clusters[i]]);
+                if (_upper[i] < m) continue;
+            }
+
+            // compare to all centers, first minimum wins as in distribute_samples()
+            std::size_t best = 0;
+            double d1 = std::numeric_limits<double>::max();
+            double d2 = std::numeric_limits<double>::max();
+            for (std::size_t c = 0; c < _centers.size(); c++)
+            {
+                double d = _distfn(x, _centers[c]);
+                if (d < d1)
                 {
-                    _clusters[i] = c;
-                    currentchanges++;
+                    d2 = d1;
+                    d1 = d;
+                    best = c;
                 }
-//if (i % 1000 == 0) std::cout << "kmeans distribute: " << i << std::endl;
+                else if (d < d2)
+                {
+                    d2 = d;
+                }
+            }
+
+            if (_clusters[i] != best)
+            {
+                _clusters[i] = best;
+                changes++;
             }
+
+            _upper[i] = kmeans_metric<dist_fn>::apply(d1);
+            _lower[i] = (_centers.size() > 1) ? kmeans_metric<dist_fn>::apply(d2) : std::numeric_limits<double>::max();
+        }
+
+        _threadchanges[thread] += changes;
+    }
+
+    // adjusts the bounds after the centers have moved from oldcenters to _centers,
+    // samples in reassigned have been made centers themselves
+    void update_bounds(const std::vector<sample_t>& oldcenters, const std::vector<std::size_t>& reassigned)
+    {
+        std::vector<double> moved(_centers.size());
+        for (std::size_t c = 0; c < _centers.size(); c++) moved[c] = metric(oldcenters[c], _centers[c]);
+
+        // the lower bound decreases by at most the largest movement of any other center
+        std::size_t largest = std::distance(moved.begin(), std::max_element(moved.begin(), moved.end()));
+        double secondlargest = 0;
+        for (std::size_t c = 0; c < moved.size(); c++)
+        {
+            if (c != largest) secondlargest = std::max(secondlargest, moved[c]);
         }
 
+        run_chunked(_collection.size(), samples_per_chunk, boost::bind(&kmeans::move_bounds, this, boost::cref(moved), largest, secondlargest, _1, _2));
+
+        for (std::size_t i = 0; i < reassigned.size(); i++)
         {
-            locker_t locker(mutex);
-            changes += currentchanges;
+            _upper[reassigned[i]] = 0;
+            _lower[reassigned[i]] = 0;
+        }
+    }
+
+    void move_bounds(const std::vector<double>& moved, std::size_t largest, double secondlargest, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; i++)
+        {
+            std::size_t a = _clusters[i];
+            _upper[i] += moved[a];
+            _lower[i] -= (a == largest) ? secondlargest : moved[largest];
+        }
+    }
+
+    // the pool is started on first use and restarted if the number of threads has changed
+    imdb::ThreadPool& pool()
+    {
+        if (!_pool || _pool->size() != _numthreads) _pool.reset(new imdb::ThreadPool(_numthreads));
+        return *_pool;
+    }
+
+    // calls fn(begin, end, thread) on chunks [begin, end) of [0, n) in parallel. Threads fetch
+    // the next chunk from an atomic counter, i.e. faster threads simply process more chunks
+    template <class fn_t>
+    void run_chunked(std::size_t n, std::size_t chunksize, fn_t fn)
+    {
+        _nextchunk.store(0);
+        pool().run(boost::bind(&kmeans::process_chunks<fn_t>, this, n, chunksize, boost::cref(fn), _1));
+    }
+
+    template <class fn_t>
+    void process_chunks(std::size_t n, std::size_t chunksize, const fn_t& fn, std::size_t thread)
+    {
+        for (;;)
+        {
+            std::size_t begin = _nextchunk.fetch_add(chunksize, boost::memory_order_relaxed);
+            if (begin >= n) break;
+            fn(begin, std::min(begin + chunksize, n), thread);
         }
     }
 
     const collection_t& _collection;
-    const dist_fn&      _distfn;
+    const dist_fn       _distfn;
 
     std::vector<sample_t>    _centers;
     std::vector<std::size_t> _clusters;
 
-    boost::mutex        _mutex;
+    std::size_t _numthreads;
+    bool        _verbose;
+    bool        _accelerated;
+
+    // state of the accelerated version: bounds per sample and half
+    // the distance to the closest other center
+    std::vector<double>      _upper;
+    std::vector<double>      _lower;
+    std::vector<double>      _halfmin;
+
+    // changes of the current assignment step per thread
+    std::vector<std::size_t> _threadchanges;
+
+    // sample indices sorted by cluster, the members of cluster c
+    // are at [_memberoffsets[c], _memberoffsets[c+1]) in _members
+    std::vector<std::size_t> _members;
+    std::vector<std::size_t> _memberoffsets;
+
+    boost::scoped_ptr<imdb::ThreadPool> _pool;
+    boost::atomic<std::size_t>          _nextchunk;
 };
 
 
@@ -10,9 +10,16 @@ the terms of the BSD license (see the LICENSE file).
 #define KMEANS_INIT_HPP
 
 #include <vector>
+#include <set>
+#include <limits>
+#include <numeric>
+#include <iostream>
+#include <iterator>
 #include <boost/random.hpp>
+#include <boost/bind.hpp>
 
 #include "../search/distance.hpp"
+#include "thread_pool.hpp"
 
 template <class index_t, class collection_t>
 void kmeans_init_random(std::vector<index_t>& centers, const collection_t& collection, std::size_t numclusters)
@@ -25,13 +32,208 @@ void kmeans_init_random(std::vector<index_t>& centers, const collection_t& colle
     centers.resize(numclusters);
 }
 
+/**
+ * @brief Distance of each sample to its closest center chosen so far, shared by the kmeans++ and kmeans|| initializers.
+ *
+ * All passes over the collection are run in parallel on a thread pool. The collection is processed in fixed blocks
+ * and all sums are accumulated per block and then in block order, such that the results do not depend on the number
+ * of threads. Optionally, each sample has a weight that multiplies its contribution to the potential.
+ */
+template <class collection_t, class dist_fn>
+class kmeans_init_state
+{
+    public:
+
+    kmeans_init_state(const collection_t& collection, const dist_fn& distfn, std::size_t numthreads, const std::vector<double>* weights = 0)
+        : _collection(collection), _distfn(distfn), _weights(weights), _pool(std::max<std::size_t>(numthreads, 1))
+        , _numblocks((collection.size() + block_size - 1) / block_size)
+        , _dists(collection.size(), std::numeric_limits<double>::max()), _nearest(collection.size(), 0)
+        , _blocksums(_numblocks, 0.0), _numcenters(0), _potential(0.0), _candidates(0), _oversampling(0), _seed(0)
+    {}
+
+    /// Adds centers, i.e. updates the distance of each sample to its closest center
+    void add_centers(const std::vector<std::size_t>& indices)
+    {
+        _candidates = &indices;
+        run(&kmeans_init_state::add_centers_block);
+        _numcenters += indices.size();
+        _potential = std::accumulate(_blocksums.begin(), _blocksums.end(), 0.0);
+    }
+
+    /// Potential after adding each of the candidates (on its own), the state is not changed
+    void trial_potentials(const std::vector<std::size_t>& candidates, std::vector<double>& potentials)
+    {
+        _candidates = &candidates;
+        _trialsums.assign(_numblocks * candidates.size(), 0.0);
+        run(&kmeans_init_state::trial_block);
+
+        potentials.assign(candidates.size(), 0.0);
+        for (std::size_t b = 0; b < _numblocks; b++)
+        {
+            for (std::size_t t = 0; t < candidates.size(); t++) potentials[t] += _trialsums[b * candidates.size() + t];
+        }
+    }
+
+    /// D^2 sampling: returns sample i with probability proportional to its contribution to
+    /// the potential, given r uniformly distributed in [0, 1)
+    std::size_t sample(double r) const
+    {
+        double target = r * _potential;
+        for (std::size_t b = 0; b < _numblocks; b++)
+        {
+            if (target >= _blocksums[b] && b + 1 < _numblocks)
+            {
+                target -= _blocksums[b];
+                continue;
+            }
+
+            std::size_t end = std::min((b + 1) * block_size, _collection.size());
+            for (std::size_t i = b * block_size; i < end; i++)
+            {
+                double p = contribution(i);
+                if (target < p) return i;
+                target -= p;
+            }
+            return end - 1;
+        }
+        return 0;
+    }
+
+    /// kmeans|| sampling: selects each sample independently with probability min(1, oversampling * contribution / potential).
+    /// The random numbers depend on seed and the sample only, use a different seed in each round
+    void oversample(double oversampling, std::size_t seed, std::vector<std::size_t>& selected)
+    {
+        _oversampling = oversampling;
+        _seed = seed;
+        _selected.assign(_numblocks, std::vector<std::size_t>());
+        run(&kmeans_init_state::oversample_block);
+
+        selected.clear();
+        for (std::size_t b = 0; b < _numblocks; b++) selected.insert(selected.end(), _selected[b].begin(), _selected[b].end());
+    }
+
+    /// Sum of the weights of all samples closest to each center, in the order the centers were added
+    void center_weights(std::vector<double>& weights) const
+    {
+        weights.assign(_numcenters, 0.0);
+        for (std::size_t i = 0; i < _collection.size(); i++) weights[_nearest[i]] += _weights ? (*_weights)[i] : 1.0;
+    }
+
+    double potential() const { return _potential; }
+
+    private:
+
+    static const std::size_t block_size = 4096;
+
+    double contribution(std::size_t i) const
+    {
+        return _weights ? (*_weights)[i] * _dists[i] : _dists[i];
+    }
+
+    // calls fn on all blocks, block b is processed by thread b % numthreads
+    void run(void (kmeans_init_state::*fn)(std::size_t))
+    {
+        _pool.run(boost::bind(&kmeans_init_state::run_blocks, this, fn, _1));
+    }
+
+    void run_blocks(void (kmeans_init_state::*fn)(std::size_t), std::size_t thread)
+    {
+        for (std::size_t b = thread; b < _numblocks; b += _pool.size()) (this->*fn)(b);
+    }
+
+    void add_centers_block(std::size_t b)
+    {
+        const std::vector<std::size_t>& candidates = *_candidates;
+        std::size_t end = std::min((b + 1) * block_size, _collection.size());
+
+        double sum = 0.0;
+        for (std::size_t i = b * block_size; i < end; i++)
+        {
+            for (std::size_t c = 0; c < candidates.size(); c++)
+            {
+                double d = _distfn(_collection[candidates[c]], _collection[i]);
+                if (d*d < _dists[i])
+                {
+                    _dists[i] = d*d;
+                    _nearest[i] = _numcenters + c;
+                }
+            }
+            sum += contribution(i);
+        }
+        _blocksums[b] = sum;
+    }
+
+    void trial_block(std::size_t b)
+    {
+        const std::vector<std::size_t>& candidates = *_candidates;
+        std::size_t end = std::min((b + 1) * block_size, _collection.size());
+
+        double* sums = &_trialsums[b * candidates.size()];
+        for (std::size_t i = b * block_size; i < end; i++)
+        {
+            double w = _weights ? (*_weights)[i] : 1.0;
+            for (std::size_t t = 0; t < candidates.size(); t++)
+            {
+                double d = _distfn(_collection[candidates[t]], _collection[i]);
+                sums[t] += w * std::min(_dists[i], d*d);
+            }
+        }
+    }
+
+    void oversample_block(std::size_t b)
+    {
+        boost::mt19937 rng(static_cast<boost::uint32_t>(_seed * _numblocks + b));
+        boost::uniform_01<boost::mt19937&> unirand(rng);
+
+        std::size_t end = std::min((b + 1) * block_size, _collection.size());
+        for (std::size_t i = b * block_size; i < end; i++)
+        {
+            double p = _oversampling * contribution(i) / _potential;
+            if (unirand() < p) _selected[b].push_back(i);
+        }
+    }
+
+    const collection_t&        _collection;
+    const dist_fn&             _distfn;
+    const std::vector<double>* _weights;
+
+    imdb::ThreadPool _pool;
+    std::size_t      _numblocks;
+
+    // squared distance of each sample to its closest center and the number of that center
+    std::vector<double>      _dists;
+    std::vector<std::size_t> _nearest;
+
+    std::vector<double> _blocksums;
+    std::size_t         _numcenters;
+    double              _potential;
+
+    // arguments and results of the block functions
+    const std::vector<std::size_t>*       _candidates;
+    std::vector<double>                   _trialsums;
+    std::vector<std::vector<std::size_t> > _selected;
+    double                                _oversampling;
+    std::size_t                           _seed;
+};
+
+
+/**
+ * @brief Greedy kmeans++ initialization (Arthur & Vassilvitskii - k-means++: The Advantages of Careful Seeding)
+ *
+ * Each new center is the best of 2 + log(numclusters) candidates drawn by D^2 sampling, i.e. the one that reduces the
+ * potential most. Candidate evaluation and the distance updates are parallelized over the samples.
+ *
+ * @param result Indices of the chosen samples
+ * @param numthreads Number of threads
+ * @param weights Optional weight of each sample, multiplies its contribution to the potential
+ */
 template <class index_t, class collection_t, class dist_fn>
-void kmeans_init_plusplus(std::vector<index_t>& result, const collection_t& collection, std::size_t numclusters, const dist_fn& distfn)
+void kmeans_init_plusplus(std::vector<index_t>& result, const collection_t& collection, std::size_t numclusters, const dist_fn& distfn,
+                          std::size_t numthreads = 1, const std::vector<double>* weights = 0)
 {
     assert(numclusters > 0);
     assert(collection.size() >= numclusters);
 
-    typedef typename collection_t::value_type item_t;
     typedef boost::mt19937                    rng_t;
     typedef boost::uniform_real<double>       unirand_t;
 
@@ -43,75 +245,118 @@ void kmeans_init_plusplus(std::vector<index_t>& result, const collection_t& coll
 
     // add first cluster, randomly chosen
     std::set<index_t> centers;
-    index_t first = unirand() * collection.size();
-    centers.insert(first);
+    std::vector<std::size_t> current(1, static_cast<std::size_t>(unirand() * collection.size()));
+    centers.insert(current[0]);
 
     // compute distance between first cluster center and all others
     // and accumulate the distances that gives the current potential
-    std::vector<double> dists(collection.size());
-    double potential = 0.0;
-    for (std::size_t i = 0; i < collection.size(); i++)
-    {
-        double d = distfn(collection[first], collection[i]);
-        dists[i] = d*d;
-        potential += dists[i];
-    }
-    std::cout << "kmeans++ init: numclusters=" << numclusters << " numtrials=" << numtrials << " collection.size=" << collection.size() << " init pot=" << potential << std::endl;
+    kmeans_init_state<collection_t, dist_fn> state(collection, distfn, numthreads, weights);
+    state.add_centers(current);
+    std::cout << "kmeans++ init: numclusters=" << numclusters << " numtrials=" << numtrials << " collection.size=" << collection.size() << " init pot=" << state.potential() << std::endl;
 
     // iteratively add centers
+    std::vector<std::size_t> trials(numtrials);
+    std::vector<double> potentials;
     for (std::size_t c = 1; c < numclusters; c++)
     {
-        double min_potential = std::numeric_limits<double>::max();
-        std::size_t best_index = 0;
-
+        // get new center candidates
         for (std::size_t i = 0; i < numtrials; i++)
         {
-            std::size_t index;
+            std::size_t index = state.sample(unirand());
+            while (centers.count(index) > 0) index = (index + 1) % collection.size();
+            trials[i] = index;
+        }
 
-            // get new center
-            double r = unirand() * potential;
-            for (index = 0; index < collection.size()-1 && r > dists[index]; index++)
-            {
-                r -= dists[index];
-            }
+        // keep the one giving the lowest potential
+        state.trial_potentials(trials, potentials);
+        std::size_t best = std::distance(potentials.begin(), std::min_element(potentials.begin(), potentials.end()));
 
-            while (centers.count(index) > 0) index = (index + 1) % collection.size();
+        current[0] = trials[best];
+        state.add_centers(current);
+        centers.insert(current[0]);
 
-            // recompute potential
-            double p = 0.0;
-            for (std::size_t k = 0; k < collection.size(); k++)
-            {
-                double d = distfn(collection[index], collection[k]);
-                p += std::min(dists[k], d*d);
-            }
+        std::cout << "new center " << c << ": potential=" << state.potential() << " index=" << current[0] << std::endl;
+    }
 
-            if (p < min_potential)
-            {
-                min_potential = p;
-                best_index = index;
-            }
-        }
+    std::copy(centers.begin(), centers.end(), std::back_inserter(result));
+}
 
-        for (std::size_t i = 0; i < collection.size(); i++)
-        {
-            double d = distfn(collection[best_index], collection[i]);
-            dists[i] = d*d;
-        }
 
-        potential = min_potential;
+/**
+ * @brief Scalable kmeans++ initialization, kmeans|| (Bahmani et al. - Scalable K-Means++)
+ *
+ * Instead of one center per pass over the data, each of the \p rounds passes samples about oversampling * numclusters
+ * candidates at once, each sample independently with probability proportional to its squared distance to the closest
+ * candidate so far. The candidates are then weighted by the number of samples closest to them and reduced to
+ * numclusters centers using the greedy kmeans++ on the (small) weighted candidate set. Should there be less
+ * candidates than clusters, the missing centers are added by D^2 sampling.
+ *
+ * @param result Indices of the chosen samples
+ * @param numthreads Number of threads
+ * @param rounds Number of sampling rounds
+ * @param oversampling Expected number of candidates per round, as a factor of numclusters
+ */
+template <class index_t, class collection_t, class dist_fn>
+void kmeans_init_parallel(std::vector<index_t>& result, const collection_t& collection, std::size_t numclusters, const dist_fn& distfn,
+                          std::size_t numthreads = 1, std::size_t rounds = 5, double oversampling = 2.0)
+{
+    assert(numclusters > 0);
+    assert(collection.size() >= numclusters);
+
+    boost::mt19937 rng;
+    boost::uniform_01<boost::mt19937&> unirand(rng);
+
+    // first candidate, randomly chosen
+    std::vector<std::size_t> candidates(1, static_cast<std::size_t>(unirand() * collection.size()));
 
-        centers.insert(best_index);
+    kmeans_init_state<collection_t, dist_fn> state(collection, distfn, numthreads);
+    state.add_centers(candidates);
+
+    std::vector<std::size_t> selected;
+    for (std::size_t r = 0; r < rounds && state.potential() > 0; r++)
+    {
+        state.oversample(oversampling * numclusters, r, selected);
+        state.add_centers(selected);
+        candidates.insert(candidates.end(), selected.begin(), selected.end());
 
-        std::cout << "new center " << c << ": potential=" << potential << " index=" << best_index << std::endl;
+        std::cout << "kmeans|| init: round " << r << " candidates=" << candidates.size() << " pot=" << state.potential() << std::endl;
     }
 
-    std::copy(centers.begin(), centers.end(), std::back_inserter(result));
+    result.clear();
+    if (candidates.size() <= numclusters)
+    {
+        // too few candidates, e.g. because of many duplicate samples: add centers one at a time
+        std::set<std::size_t> centers(candidates.begin(), candidates.end());
+        std::vector<std::size_t> current(1);
+        while (centers.size() < numclusters)
+        {
+            std::size_t index = state.sample(unirand());
+            while (centers.count(index) > 0) index = (index + 1) % collection.size();
+            current[0] = index;
+            state.add_centers(current);
+            centers.insert(index);
+        }
+        std::copy(centers.begin(), centers.end(), std::back_inserter(result));
+        return;
+    }
+
+    // recluster the weighted candidates
+    std::vector<double> weights;
+    state.center_weights(weights);
+
+    collection_t reduced(candidates.size());
+    for (std::size_t i = 0; i < candidates.size(); i++) reduced[i] = collection[candidates[i]];
+
+    std::vector<std::size_t> chosen;
+    kmeans_init_plusplus(chosen, reduced, numclusters, distfn, numthreads, &weights);
+    for (std::size_t i = 0; i < chosen.size(); i++) result.push_back(candidates[chosen[i]]);
 }
 
 enum KmeansInitAlgorithm
 {
     KmeansInitRandom,
-    KmeansInitPlusPlus
+    KmeansInitPlusPlus,
+    KmeansInitParallel
 };
 
 #endif // KMEANS_INIT_HPP
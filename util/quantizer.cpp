@@ -6,10 +6,174 @@ This file is part of the imdb library and is made available under
 the terms of the BSD license (see the LICENSE file).
 */
 
+#include <algorithm>
+#include <limits>
+
 #include "quantizer.hpp"
 
 namespace imdb {
 
+namespace
+{
+
+struct less_first
+{
+    bool operator()(const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) const { return a.first < b.first; }
+};
+
+// Offset of the histogram of the spatial cell sample i falls into
+//
+// If the user has chosen res = 1 we do not care about the content
+// of the positions vector as they are only accessed for res > 1
+size_t cell_offset(const vec_vec_f32_t& positions, size_t i, int res, size_t vocabularySize)
+{
+    if (res == 1) return 0;
+
+    int x = static_cast<int>(positions[i][0] * res);
+    int y = static_cast<int>(positions[i][1] * res);
+    if (x == res) x--; // handles the case positions[i][0] = 1.0
+    if (y == res) y--; // handles the case positions[i][1] = 1.0
+
+    // generate a linear index from 2D (x,y) index
+    int idx = y*res + x;
+    assert(idx >= 0 && idx < res*res);
+
+    // identify the spatial histogram we want to add to
+    return vocabularySize*idx;
+}
+
+// Uniform access to the non-zero entries of the different kinds of quantized features
+
+struct dense_features
+{
+    dense_features(const vec_vec_f32_t& f) : _f(f) {}
+    size_t size() const { return _f.size(); }
+    size_t count(size_t i) const { return _f[i].size(); }
+    uint32_t word(size_t /*i*/, size_t j) const { return static_cast<uint32_t>(j); }
+    float weight(size_t i, size_t j) const { return _f[i][j]; }
+    const vec_vec_f32_t& _f;
+};
+
+struct sparse_features
+{
+    sparse_features(const vector<sparse_quantized_t>& f) : _f(f) {}
+    size_t size() const { return _f.size(); }
+    size_t count(size_t i) const { return _f[i].size(); }
+    uint32_t word(size_t i, size_t j) const { return _f[i][j].first; }
+    float weight(size_t i, size_t j) const { return _f[i][j].second; }
+    const vector<sparse_quantized_t>& _f;
+};
+
+struct word_features
+{
+    word_features(const vector<uint32_t>& f) : _f(f) {}
+    size_t size() const { return _f.size(); }
+    size_t count(size_t /*i*/) const { return 1; }
+    uint32_t word(size_t i, size_t /*j*/) const { return _f[i]; }
+    float weight(size_t /*i*/, size_t /*j*/) const { return 1; }
+    const vector<uint32_t>& _f;
+};
+
+
+// Offsets of the histograms feature i is added to on each
+// pyramid level, relative to the start of the concatenated histogram
+void pyramid_offsets(const vec_vec_f32_t& positions, size_t i, size_t levels, size_t vocabularySize, vector<size_t>& offsets)
+{
+    size_t levelOffset = 0;
+    for (size_t l = 0; l < levels; l++)
+    {
+        int res = 1 << l;
+        offsets[l] = levelOffset + cell_offset(positions, i, res, vocabularySize);
+        levelOffset += res*res*vocabularySize;
+    }
+}
+
+size_t pyramid_size(size_t vocabularySize, size_t levels)
+{
+    // sum of 4^l for l in [0,levels)
+    return vocabularySize * (((size_t(1) << (2*levels)) - 1) / 3);
+}
+
+template <class features_t>
+void build_pyramid(const features_t& features, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    assert(levels > 0);
+    assert(vocabularySize > 0);
+    if (levels > 1) assert(positions.size() == features.size());
+
+    histvw.assign(pyramid_size(vocabularySize, levels), 0);
+
+    vector<size_t> offsets(levels);
+    for (size_t i = 0; i < features.size(); i++)
+    {
+        pyramid_offsets(positions, i, levels, vocabularySize, offsets);
+
+        for (size_t j = 0; j < features.count(i); j++)
+        {
+            float w = features.weight(i, j);
+            if (!w) continue;
+
+            uint32_t word = features.word(i, j);
+            assert(word < vocabularySize);
+            for (size_t l = 0; l < levels; l++) histvw[offsets[l] + word] += w;
+        }
+    }
+
+    // see build_histvw for the normalization
+    if (normalize && features.size() > 0)
+    {
+        size_t numSamples = features.size();
+        for (size_t i = 0; i < histvw.size(); i++)
+            histvw[i] /= numSamples;
+    }
+}
+
+template <class features_t>
+void build_pyramid(const features_t& features, size_t vocabularySize, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    assert(levels > 0);
+    assert(vocabularySize > 0);
+    assert(pyramid_size(vocabularySize, levels) <= std::numeric_limits<uint32_t>::max());
+    if (levels > 1) assert(positions.size() == features.size());
+
+    // collect all contributions, then sum up those to the same bin
+    sparse_quantized_t entries;
+    vector<size_t> offsets(levels);
+    for (size_t i = 0; i < features.size(); i++)
+    {
+        pyramid_offsets(positions, i, levels, vocabularySize, offsets);
+
+        for (size_t j = 0; j < features.count(i); j++)
+        {
+            float w = features.weight(i, j);
+            if (!w) continue;
+
+            uint32_t word = features.word(i, j);
+            assert(word < vocabularySize);
+            for (size_t l = 0; l < levels; l++) entries.push_back(std::make_pair(static_cast<uint32_t>(offsets[l] + word), w));
+        }
+    }
+
+    // stable to add up the contributions to a bin in the order of the features
+    std::stable_sort(entries.begin(), entries.end(), less_first());
+
+    histvw.clear();
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (histvw.empty() || histvw.back().first != entries[i].first) histvw.push_back(entries[i]);
+        else histvw.back().second += entries[i].second;
+    }
+
+    if (normalize && features.size() > 0)
+    {
+        size_t numSamples = features.size();
+        for (size_t i = 0; i < histvw.size(); i++)
+            histvw[i].second /= numSamples;
+    }
+}
+
+} // anonymous namespace
+
 void quantize_samples_parallel(const vec_vec_f32_t& samples, const vec_vec_f32_t& vocabulary, vec_vec_f32_t& quantized_samples, quantize_fn& quantizer)
 {
     quantized_samples.resize(samples.size());
@@ -22,6 +186,17 @@ void quantize_samples_parallel(const vec_vec_f32_t& samples, const vec_vec_f32_t
     }
 }
 
+void quantize_samples_parallel(const vec_vec_f32_t& samples, vector<uint32_t>& words, const quantize_index_fn& quantizer)
+{
+    words.resize(samples.size());
+
+    #pragma omp parallel for
+    for (long i = 0; i < static_cast<long>(samples.size()); i++)
+    {
+        words[i] = quantizer(samples[i]);
+    }
+}
+
 void build_histvw(const vec_vec_f32_t& quantized_features, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, int res)
 {
 
@@ -52,28 +227,7 @@ void build_histvw(const vec_vec_f32_t& quantized_features, size_t vocabularySize
         // in the case of res = 1, offset will be zero and
         // we only have a single histogram (no pyramid) and
         // thus the offset into this overall histogram will be zero
-        int offset = 0;
-
-        // ----------------------------------------------------------------
-        // Special path for building a spatial pyramid
-        //
-        // If the user has chosen res = 1 we do not care about the content
-        // of the positions vector as they are only accessed for res > 1
-        if (res > 1)
-        {
-            int x = static_cast<int>(positions[i][0] * res);
-            int y = static_cast<int>(positions[i][1] * res);
-            if (x == res) x--; // handles the case positions[i][0] = 1.0
-            if (y == res) y--; // handles the case positions[i][1] = 1.0
-
-            // generate a linear index from 2D (x,y) index
-            int idx = y*res + x;
-            assert(idx >= 0 && idx < res*res);
-
-            // identify the spatial histogram we want to add to
-            offset = vocabularySize*idx;
-        }
-        // -----------------------------------------------------------------
+        size_t offset = cell_offset(positions, i, res, vocabularySize);
 
 
         // Build up histogram by adding the quantized feature to the
@@ -97,6 +251,89 @@ void build_histvw(const vec_vec_f32_t& quantized_features, size_t vocabularySize
     }
 }
 
+void build_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, int res)
+{
+    assert(res > 0);
+    assert(vocabularySize > 0);
+    if (res > 1) assert(positions.size() == quantized_features.size());
+
+    histvw.resize(res*res*vocabularySize, 0);
+
+    for (size_t i = 0; i < quantized_features.size(); i++)
+    {
+        size_t offset = cell_offset(positions, i, res, vocabularySize);
+
+        const sparse_quantized_t& q = quantized_features[i];
+        for (size_t j = 0; j < q.size(); j++)
+        {
+            assert(q[j].first < vocabularySize);
+            histvw[offset + q[j].first] += q[j].second;
+        }
+    }
+
+    // see the dense version for the normalization
+    if (normalize && quantized_features.size() > 0)
+    {
+        size_t numSamples = quantized_features.size();
+        for (size_t i = 0; i < histvw.size(); i++)
+            histvw[i] /= numSamples;
+    }
+}
+
+void build_histvw(const vector<uint32_t>& words, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, int res)
+{
+    assert(res > 0);
+    assert(vocabularySize > 0);
+    if (res > 1) assert(positions.size() == words.size());
+
+    histvw.resize(res*res*vocabularySize, 0);
+
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        assert(words[i] < vocabularySize);
+        histvw[cell_offset(positions, i, res, vocabularySize) + words[i]] += 1;
+    }
+
+    // see the dense version for the normalization
+    if (normalize && words.size() > 0)
+    {
+        size_t numSamples = words.size();
+        for (size_t i = 0; i < histvw.size(); i++)
+            histvw[i] /= numSamples;
+    }
+}
+
+
+void build_pyramid_histvw(const vec_vec_f32_t& quantized_features, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(dense_features(quantized_features), vocabularySize, histvw, normalize, positions, levels);
+}
+
+void build_pyramid_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(sparse_features(quantized_features), vocabularySize, histvw, normalize, positions, levels);
+}
+
+void build_pyramid_histvw(const vector<uint32_t>& words, size_t vocabularySize, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(word_features(words), vocabularySize, histvw, normalize, positions, levels);
+}
+
+void build_pyramid_histvw(const vec_vec_f32_t& quantized_features, size_t vocabularySize, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(dense_features(quantized_features), vocabularySize, histvw, normalize, positions, levels);
+}
+
+void build_pyramid_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabularySize, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(sparse_features(quantized_features), vocabularySize, histvw, normalize, positions, levels);
+}
+
+void build_pyramid_histvw(const vector<uint32_t>& words, size_t vocabularySize, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels)
+{
+    build_pyramid(word_features(words), vocabularySize, histvw, normalize, positions, levels);
+}
+
 
 } // end namespace
 
@@ -10,6 +10,8 @@ the terms of the BSD license (see the LICENSE file).
 #define QUANTIZER_HPP
 
 #include "types.hpp"
+#include "vocabulary_tree.hpp"
+#include "kdforest.hpp"
 
 namespace imdb {
 
@@ -42,13 +44,20 @@ struct quantize_hard {
      */
     void operator()(const sample_t& sample, const vector<sample_t>& vocabulary, vec_f32_t& quantized_sample)
     {
-
         // this should be very efficient in case the
         // result vector already has the correct size
-        // TODO: we need to make sure that all entries
-        // are zero!
-        quantized_sample.resize(vocabulary.size());
+        quantized_sample.assign(vocabulary.size(), 0);
+        quantized_sample[index(sample, vocabulary)] = 1;
+    }
 
+    /**
+     * @brief Index of the entry in \p vocabulary that is closest to \p sample.
+     *
+     * Use this instead of operator() together with the build_histvw() overload taking word
+     * indices to avoid creating a vocabulary-sized vector per sample.
+     */
+    uint32_t index(const sample_t& sample, const vector<sample_t>& vocabulary) const
+    {
         size_t closest = 0;
         float minDistance = std::numeric_limits<float>::max();
 
@@ -63,7 +72,7 @@ struct quantize_hard {
                 minDistance = distance;
             }
         }
-        quantized_sample[closest] = 1;
+        return static_cast<uint32_t>(closest);
     }
 };
 
@@ -118,6 +127,71 @@ struct quantize_fuzzy
 
 
 
+/**
+ * @brief Functor performing hard quantization of a sample by descending a VocabularyTree
+ *
+ * Gives the same kind of result as quantize_hard but costs only O(b * depth * d) per sample instead
+ * of O(K * d). The vocabulary passed to operator() is ignored as the tree holds its own words, it only
+ * exists to make the functor interchangeable with quantize_hard and quantize_fuzzy.
+ */
+struct quantize_tree
+{
+    quantize_tree(shared_ptr<const VocabularyTree> tree) : _tree(tree)
+    {
+        assert(_tree);
+    }
+
+    void operator()(const vec_f32_t& sample, const vec_vec_f32_t& /*vocabulary*/, vec_f32_t& quantized_sample)
+    {
+        quantized_sample.assign(_tree->num_words(), 0);
+        quantized_sample[(*this)(sample)] = 1;
+    }
+
+    /// Word index of sample, makes the functor assignable to quantize_index_fn
+    uint32_t operator()(const vec_f32_t& sample) const
+    {
+        return _tree->quantize(sample);
+    }
+
+    shared_ptr<const VocabularyTree> _tree;
+};
+
+
+
+/**
+ * @brief Functor performing approximate hard quantization using a KdForest built over the vocabulary
+ *
+ * The nearest word is searched in a forest of randomized k-d trees, comparing the sample to at most
+ * \p checks words. This is much faster than quantize_hard for large vocabularies at the cost of
+ * occasionally picking a word that is close to, but not exactly, the nearest one. The result has
+ * the same form as that of quantize_hard, the vocabulary passed to operator() is ignored.
+ */
+struct quantize_approx
+{
+    /// @param checks Maximum number of words compared to each sample, 0 uses the forest's default
+    quantize_approx(shared_ptr<const KdForest> forest, size_t checks = 0) : _forest(forest), _checks(checks)
+    {
+        assert(_forest);
+    }
+
+    void operator()(const vec_f32_t& sample, const vec_vec_f32_t& /*vocabulary*/, vec_f32_t& quantized_sample)
+    {
+        quantized_sample.assign(_forest->size(), 0);
+        quantized_sample[(*this)(sample)] = 1;
+    }
+
+    /// Word index of sample, makes the functor assignable to quantize_index_fn
+    uint32_t operator()(const vec_f32_t& sample) const
+    {
+        return _forest->nearest(sample, _checks);
+    }
+
+    shared_ptr<const KdForest> _forest;
+    size_t _checks;
+};
+
+
+
 /**
  * @brief 'Base-class' for a quantization function.
  *
@@ -127,6 +201,22 @@ struct quantize_fuzzy
  */
 typedef boost::function<void (const vec_f32_t&, const vec_vec_f32_t&, vec_f32_t&)> quantize_fn;
 
+/**
+ * @brief Hard quantization function that directly returns the index of the word a sample is assigned to.
+ *
+ * Both quantize_tree and quantize_approx can be assigned to this function type.
+ */
+typedef boost::function<uint32_t (const vec_f32_t&)> quantize_index_fn;
+
+
+
+/**
+ * @brief Sparse quantized sample, i.e. the (word, weight) pairs of all words with a non-zero weight.
+ *
+ * Used for fuzzy quantization that is truncated to the k nearest words, see BatchQuantizer::quantize_fuzzy_knn().
+ */
+typedef vector<std::pair<uint32_t, float> > sparse_quantized_t;
+
 
 
 
@@ -140,6 +230,14 @@ typedef boost::function<void (const vec_f32_t&, const vec_vec_f32_t&, vec_f32_t&
  */
 void quantize_samples_parallel(const vec_vec_f32_t& samples, const vec_vec_f32_t& vocabulary, vec_vec_f32_t& quantized_samples, quantize_fn& quantizer);
 
+/**
+ * @brief Convenience function that hard quantizes a vector of samples in parallel
+ * @param samples Vector of samples to be quantized
+ * @param words Index of the word each sample is assigned to, same size as \p samples
+ * @param quantizer quantization function to be used
+ */
+void quantize_samples_parallel(const vec_vec_f32_t& samples, vector<uint32_t>& words, const quantize_index_fn& quantizer);
+
 
 
 // Given a list of quantized samples and corresponding coordinates
@@ -155,6 +253,44 @@ void quantize_samples_parallel(const vec_vec_f32_t& samples, const vec_vec_f32_t
 // we assume that the positions lie in [0,1]x[0,1]
 void build_histvw(const vec_vec_f32_t& quantized_features, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions = vec_vec_f32_t(), int res = 1);
 
+// Same as above for sparse quantized samples, only the
+// listed words of each sample are added to the histogram
+void build_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions = vec_vec_f32_t(), int res = 1);
+
+// Same as above for hard quantized samples given by the
+// index of their word, each sample adds 1 to its word
+void build_histvw(const vector<uint32_t>& words, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions = vec_vec_f32_t(), int res = 1);
+
+
+
+/**
+ * @brief Builds the histograms of all levels of a spatial pyramid in a single pass over the quantized features.
+ *
+ * Level l divides the image into 2^l x 2^l cells, the result is the concatenation of the histograms of levels
+ * 0..levels-1, i.e. identical to appending the results of build_histvw() with res = 1, 2, ..., 2^(levels-1).
+ * The cells of each feature at all levels are computed at once and the feature is added directly into the
+ * preallocated result, i.e. each quantized feature is traversed only once.
+ *
+ * Overloads exist for dense, sparse and hard (word index) quantized features.
+ *
+ * @param levels Number of pyramid levels, at least 1. positions are only accessed if levels > 1
+ * @param histvw Result of size vocabulary_size * (4^levels - 1) / 3, any previous content is replaced
+ */
+void build_pyramid_histvw(const vec_vec_f32_t& quantized_features, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+void build_pyramid_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+void build_pyramid_histvw(const vector<uint32_t>& words, size_t vocabulary_size, vec_f32_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+
+/**
+ * @brief Same as above, but only returns the non-zero bins of the pyramid histogram.
+ *
+ * Use this for large vocabularies and/or many levels, where most bins of the pyramid are empty.
+ *
+ * @param histvw (bin, value) pairs of all non-zero bins sorted by bin, bins are indices into the dense result
+ */
+void build_pyramid_histvw(const vec_vec_f32_t& quantized_features, size_t vocabulary_size, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+void build_pyramid_histvw(const vector<sparse_quantized_t>& quantized_features, size_t vocabulary_size, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+void build_pyramid_histvw(const vector<uint32_t>& words, size_t vocabulary_size, sparse_quantized_t& histvw, bool normalize, const vec_vec_f32_t& positions, size_t levels);
+
 
 
 /** @} */
@@ -0,0 +1,212 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <QTime>
+
+#include "streaming_kmeans.hpp"
+
+namespace imdb {
+
+namespace
+{
+
+// rows streamed per block, i.e. assigned in parallel and then accumulated
+const size_t rows_per_block = 16384;
+
+// rows handed out to a thread at a time within a block
+const size_t rows_per_chunk = 256;
+
+size_t default_num_threads(size_t numthreads)
+{
+    return numthreads > 0 ? numthreads : std::max(boost::thread::hardware_concurrency(), 1u);
+}
+
+} // anonymous namespace
+
+
+StreamingKmeans::StreamingKmeans(const MappedFloatMatrix& samples, const vec_vec_f32_t& centers, size_t numthreads)
+    : _samples(samples)
+    , _centers(centers)
+    , _clusters(samples.rows(), 0)
+    , _pool(default_num_threads(numthreads))
+    , _verbose(true)
+{
+    assert(!_centers.empty());
+    for (size_t c = 0; c < _centers.size(); c++) assert(_centers[c].size() == _samples.cols());
+}
+
+
+void StreamingKmeans::run(size_t maxiteration, double minchangesfraction)
+{
+    // main iteration
+    size_t iteration = 0;
+    for (;;)
+    {
+        if (maxiteration > 0 && iteration == maxiteration) break;
+
+        QTime time;
+        time.start();
+
+        // distribute items on clusters in parallel, block by block
+        size_t changes = distribute();
+
+        iteration++;
+
+        if (_verbose) std::cout << "changes: " << changes << " distribution time: " << time.elapsed() << std::endl;
+
+        if (changes <= std::ceil(_samples.rows() * minchangesfraction)) break;
+
+        update_centers();
+
+        if (_verbose) std::cout << "iteration " << iteration << " time: " << time.elapsed() << std::endl;
+    }
+
+    if (_verbose) std::cout << "kmeans iterations: " << iteration << std::endl;
+}
+
+
+size_t StreamingKmeans::distribute()
+{
+    const size_t dim = _samples.cols();
+
+    _packed.clear();
+    for (size_t c = 0; c < _centers.size(); c++) _packed.insert(_packed.end(), _centers[c].begin(), _centers[c].end());
+
+    _sums.assign(_centers.size() * dim, 0.0);
+    _counts.assign(_centers.size(), 0);
+    _farthest.assign(_centers.size(), dist_idx_f32_t(-1, 0));
+    _threadchanges.assign(_pool.size(), 0);
+
+    for (size_t blockbegin = 0; blockbegin < _samples.rows(); blockbegin += rows_per_block)
+    {
+        size_t blockend = std::min(blockbegin + rows_per_block, _samples.rows());
+        _blockdists.resize(blockend - blockbegin);
+
+        _nextchunk.store(blockbegin);
+        _pool.run(boost::bind(&StreamingKmeans::assign_rows, this, blockbegin, blockend, _1));
+
+        // the rows of the block are still in memory
+        accumulate_rows(blockbegin, blockend);
+    }
+
+    return std::accumulate(_threadchanges.begin(), _threadchanges.end(), size_t(0));
+}
+
+
+void StreamingKmeans::assign_rows(size_t blockbegin, size_t blockend, size_t thread)
+{
+    const size_t dim = _samples.cols();
+    const size_t numcenters = _centers.size();
+
+    size_t changes = 0;
+    for (;;)
+    {
+        size_t begin = _nextchunk.fetch_add(rows_per_chunk, boost::memory_order_relaxed);
+        if (begin >= blockend) break;
+        size_t end = std::min(begin + rows_per_chunk, blockend);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* x = _samples.row(i);
+
+            // nearest center, the first one in case of ties
+            uint32_t best = 0;
+            float mindist = std::numeric_limits<float>::max();
+            for (size_t c = 0; c < numcenters; c++)
+            {
+                const float* center = &_packed[c * dim];
+                float dist = 0;
+                for (size_t j = 0; j < dim; j++)
+                {
+                    float d = x[j] - center[j];
+                    dist += d*d;
+                }
+
+                if (dist < mindist)
+                {
+                    mindist = dist;
+                    best = static_cast<uint32_t>(c);
+                }
+            }
+
+            // each row belongs to exactly one chunk, no locking needed
+            if (_clusters[i] != best)
+            {
+                _clusters[i] = best;
+                changes++;
+            }
+            _blockdists[i - blockbegin] = mindist;
+        }
+    }
+
+    _threadchanges[thread] += changes;
+}
+
+
+void StreamingKmeans::accumulate_rows(size_t blockbegin, size_t blockend)
+{
+    const size_t dim = _samples.cols();
+
+    for (size_t i = blockbegin; i < blockend; i++)
+    {
+        uint32_t c = _clusters[i];
+        const float* x = _samples.row(i);
+
+        double* sum = &_sums[c * dim];
+        for (size_t j = 0; j < dim; j++) sum[j] += x[j];
+        _counts[c]++;
+
+        float dist = _blockdists[i - blockbegin];
+        if (dist > _farthest[c].first) _farthest[c] = dist_idx_f32_t(dist, static_cast<uint32_t>(i));
+    }
+}
+
+
+void StreamingKmeans::update_centers()
+{
+    const size_t dim = _samples.cols();
+
+    std::vector<size_t> invalid;
+    for (size_t c = 0; c < _centers.size(); c++)
+    {
+        if (_counts[c] == 0)
+        {
+            invalid.push_back(c);
+            continue;
+        }
+
+        for (size_t j = 0; j < dim; j++) _centers[c][j] = static_cast<float>(_sums[c * dim + j] / _counts[c]);
+    }
+
+    // fix invalid centers, i.e. those with no members: use the farthest members
+    // of the clusters whose farthest member is farthest away from its center
+    for (size_t k = 0; k < invalid.size(); k++)
+    {
+        size_t c = std::distance(_farthest.begin(), std::max_element(_farthest.begin(), _farthest.end()));
+        if (_farthest[c].first <= 0) break;
+
+        size_t sample = _farthest[c].second;
+        _samples.get(_centers[invalid[k]], sample);
+        _clusters[sample] = static_cast<uint32_t>(invalid[k]);
+        _farthest[c].first = -1;
+
+        if (_verbose) std::cout << "reassign " << invalid[k] << " to sample " << sample << " of cluster " << c << std::endl;
+    }
+}
+
+} // namespace imdb
@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef STREAMING_KMEANS_HPP
+#define STREAMING_KMEANS_HPP
+
+#include <boost/atomic.hpp>
+
+#include "types.hpp"
+#include "thread_pool.hpp"
+#include "../io/float_matrix.hpp"
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Out-of-core kmeans clustering (squared L2 distance) of the rows of a memory-mapped matrix.
+ *
+ * Same iteration and stopping criteria as kmeans::run(), but the samples are never loaded into memory
+ * as a whole: each iteration streams the matrix in blocks of consecutive rows. The rows of a block are
+ * assigned to their nearest center in parallel, then added to the new center sums while they are still
+ * in memory. Only the centers, their sums and one cluster index per sample are kept in main memory, the
+ * operating system pages the matrix in and out as needed.
+ *
+ * Empty clusters are moved to the sample farthest from its center among the members of the
+ * clusters with the largest such distance.
+ */
+class StreamingKmeans
+{
+    public:
+
+    /**
+     * @param samples Matrix whose rows are clustered, must stay valid during the lifetime of this object
+     * @param centers Initial centers, the number of centers gives the number of clusters
+     * @param numthreads Number of threads used for assigning the samples, 0 uses the number of processors
+     */
+    StreamingKmeans(const MappedFloatMatrix& samples, const vec_vec_f32_t& centers, size_t numthreads = 0);
+
+    /// See kmeans::run()
+    void run(size_t maxiteration, double minchangesfraction);
+
+    /// Enable/disable progress output on std::cout, enabled by default
+    void set_verbose(bool verbose) { _verbose = verbose; }
+
+    const vec_vec_f32_t& centers() const { return _centers; }
+
+    /// Cluster of each sample
+    const vector<uint32_t>& clusters() const { return _clusters; }
+
+    private:
+
+    size_t distribute();
+    void assign_rows(size_t blockbegin, size_t blockend, size_t thread);
+    void accumulate_rows(size_t blockbegin, size_t blockend);
+    void update_centers();
+
+    const MappedFloatMatrix& _samples;
+
+    vec_vec_f32_t    _centers;
+    vector<uint32_t> _clusters;
+
+    // all centers stored one after the other, used by the assignment
+    vec_f32_t _packed;
+
+    // sum, number and farthest member of the samples assigned to each cluster during the current iteration
+    vector<double>         _sums;
+    vector<size_t>         _counts;
+    vector<dist_idx_f32_t> _farthest;
+
+    // distance of each row of the current block to its center
+    vec_f32_t _blockdists;
+
+    ThreadPool                 _pool;
+    boost::atomic<size_t>      _nextchunk;
+    vector<size_t>             _threadchanges;
+    bool                       _verbose;
+};
+
+} // namespace imdb
+
+#endif // STREAMING_KMEANS_HPP
@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <cassert>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Fixed set of threads that repeatedly execute a task in parallel (fork-join).
+ *
+ * Avoids creating and joining threads for each parallel step of an iterative algorithm. run() calls the task once
+ * on each of the size() threads, passing the index of the thread, and returns when all calls have returned. The
+ * thread calling run() takes part as thread 0, i.e. a pool of size 1 does not start any threads at all.
+ *
+ * Tasks must not throw. run() must not be called concurrently or from within a task.
+ */
+class ThreadPool : boost::noncopyable
+{
+    public:
+
+    typedef boost::function<void (std::size_t)> task_t;
+
+    explicit ThreadPool(std::size_t numthreads) : _size(numthreads), _generation(0), _pending(0), _stop(false)
+    {
+        assert(_size > 0);
+        for (std::size_t t = 1; t < _size; t++) _threads.create_thread(boost::bind(&ThreadPool::worker, this, t));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stop = true;
+            _start.notify_all();
+        }
+        _threads.join_all();
+    }
+
+    /// Calls task(thread) for thread = 0 .. size()-1 in parallel, blocks until all calls are done
+    void run(const task_t& task)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _task = task;
+            _pending = _size - 1;
+            _generation++;
+            _start.notify_all();
+        }
+
+        task(0);
+
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        while (_pending > 0) _done.wait(lock);
+        _task.clear();
+    }
+
+    std::size_t size() const { return _size; }
+
+    private:
+
+    void worker(std::size_t thread)
+    {
+        std::size_t generation = 0;
+        for (;;)
+        {
+            task_t task;
+            {
+                boost::unique_lock<boost::mutex> lock(_mutex);
+                while (_generation == generation && !_stop) _start.wait(lock);
+                if (_stop) return;
+
+                generation = _generation;
+                task = _task;
+            }
+
+            task(thread);
+
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            if (--_pending == 0) _done.notify_one();
+        }
+    }
+
+    std::size_t         _size;
+    boost::thread_group _threads;
+
+    // _generation is incremented for each call of run(), _pending
+    // counts the workers that have not yet finished the current task
+    task_t      _task;
+    std::size_t _generation;
+    std::size_t _pending;
+    bool        _stop;
+
+    boost::mutex              _mutex;
+    boost::condition_variable _start;
+    boost::condition_variable _done;
+};
+
+} // namespace imdb
+
+#endif // THREAD_POOL_HPP
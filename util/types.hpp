@@ -54,6 +54,12 @@ typedef int64_t      index_t;
 /// datastructure pointing to the element being compared.
 typedef std::pair<double, index_t> dist_idx_t;
 
+/// Compact version of dist_idx_t used internally by the search algorithms: all distances
+/// are computed as float and indices into the search datastructures fit into 32 bits. At
+/// 8 instead of 16 bytes this halves the memory traffic when selecting the best results.
+/// Convert to dist_idx_t using to_dist_idx() at the API boundary.
+typedef std::pair<float, uint32_t> dist_idx_f32_t;
+
 typedef cv::Mat_<cv::Vec3b> mat_8uc3_t;
 typedef cv::Mat_<unsigned char> mat_8uc1_t;
 
@@ -79,6 +85,13 @@ typedef std::vector<vec_i32_t> vec_vec_i32_t;
 typedef std::map<std::string, std::string> strmap_t;
 typedef std::map<std::string, boost::any>  anymap_t;
 
+inline void to_dist_idx(const std::vector<dist_idx_f32_t>& compact, std::vector<dist_idx_t>& result)
+{
+    result.clear();
+    result.reserve(compact.size());
+    for (size_t i = 0; i < compact.size(); i++) result.push_back(dist_idx_t(compact[i].first, compact[i].second));
+}
+
 template <class T> inline
 bool less_second(const T& a, const T& b)
 {
@@ -0,0 +1,180 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+#include "vocabulary_tree.hpp"
+#include "../io/property_reader.hpp"
+#include "../io/property_writer.hpp"
+
+namespace imdb {
+
+// On disk, each node is a pair ({first_child, num_children}, center)
+typedef std::pair<vec_i32_t, vec_f32_t> tree_node_entry_t;
+
+
+VocabularyTree::VocabularyTree()
+{
+    clear(0);
+    finalize();
+}
+
+void VocabularyTree::clear(size_t dim)
+{
+    _dim = dim;
+
+    node_t root = {0, 0, -1};
+    _nodes.assign(1, root);
+    _centers.assign(_dim, 0);
+    _leaves.clear();
+}
+
+int32_t VocabularyTree::add_children(int32_t parent, const vec_vec_f32_t& centers)
+{
+    assert(parent >= 0 && parent < static_cast<int32_t>(_nodes.size()));
+    assert(_nodes[parent].num_children == 0);
+
+    int32_t first = static_cast<int32_t>(_nodes.size());
+    _nodes[parent].first_child = first;
+    _nodes[parent].num_children = static_cast<int32_t>(centers.size());
+
+    for (size_t i = 0; i < centers.size(); i++)
+    {
+        assert(centers[i].size() == _dim);
+
+        node_t child = {0, 0, -1};
+        _nodes.push_back(child);
+        _centers.insert(_centers.end(), centers[i].begin(), centers[i].end());
+    }
+
+    return first;
+}
+
+void VocabularyTree::finalize()
+{
+    _leaves.clear();
+    for (size_t i = 0; i < _nodes.size(); i++)
+    {
+        if (_nodes[i].num_children > 0)
+        {
+            _nodes[i].word = -1;
+        }
+        else
+        {
+            _nodes[i].word = static_cast<int32_t>(_leaves.size());
+            _leaves.push_back(static_cast<int32_t>(i));
+        }
+    }
+}
+
+uint32_t VocabularyTree::quantize(const vec_f32_t& sample) const
+{
+    assert(sample.size() == _dim);
+
+    const node_t* node = &_nodes[0];
+    if (node->num_children == 0) return 0;
+
+    const float* s = &sample[0];
+
+    // descend from the root, at each level choosing the closest child
+    while (node->num_children > 0)
+    {
+        int32_t best = node->first_child;
+        float minDistance = std::numeric_limits<float>::max();
+
+        for (int32_t c = node->first_child; c < node->first_child + node->num_children; c++)
+        {
+            const float* center = &_centers[c*_dim];
+
+            float distance = 0;
+            for (size_t j = 0; j < _dim; j++)
+            {
+                float d = s[j] - center[j];
+                distance += d*d;
+            }
+
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                best = c;
+            }
+        }
+
+        node = &_nodes[best];
+    }
+
+    return static_cast<uint32_t>(node->word);
+}
+
+void VocabularyTree::words(vec_vec_f32_t& words) const
+{
+    words.resize(_leaves.size());
+    for (size_t i = 0; i < _leaves.size(); i++)
+    {
+        vec_f32_t::const_iterator center = _centers.begin() + _leaves[i]*_dim;
+        words[i].assign(center, center + _dim);
+    }
+}
+
+void VocabularyTree::load(const string& filename)
+{
+    PropertyReaderT<tree_node_entry_t> reader(filename);
+    if (reader.size() == 0) throw std::runtime_error("vocabulary tree file " + filename + " contains no nodes");
+
+    tree_node_entry_t entry;
+    for (index_t i = 0; i < reader.size(); i++)
+    {
+        reader.get(entry, i);
+        if (entry.first.size() != 2) throw std::runtime_error("corrupt vocabulary tree file " + filename);
+
+        if (i == 0)
+        {
+            clear(entry.second.size());
+            _nodes.clear();
+            _centers.clear();
+        }
+        else if (entry.second.size() != _dim)
+        {
+            throw std::runtime_error("corrupt vocabulary tree file " + filename);
+        }
+
+        node_t node = {entry.first[0], entry.first[1], -1};
+        _nodes.push_back(node);
+        _centers.insert(_centers.end(), entry.second.begin(), entry.second.end());
+    }
+
+    // children must point to valid nodes
+    for (size_t i = 0; i < _nodes.size(); i++)
+    {
+        if (_nodes[i].num_children > 0 && (_nodes[i].first_child <= static_cast<int32_t>(i) || _nodes[i].first_child + _nodes[i].num_children > static_cast<int32_t>(_nodes.size())))
+        {
+            throw std::runtime_error("corrupt vocabulary tree file " + filename);
+        }
+    }
+
+    finalize();
+}
+
+void VocabularyTree::save(const string& filename) const
+{
+    PropertyWriterT<tree_node_entry_t> writer(filename);
+
+    tree_node_entry_t entry;
+    entry.first.resize(2);
+    for (size_t i = 0; i < _nodes.size(); i++)
+    {
+        entry.first[0] = _nodes[i].first_child;
+        entry.first[1] = _nodes[i].num_children;
+        entry.second.assign(_centers.begin() + i*_dim, _centers.begin() + (i + 1)*_dim);
+        writer.push_back(entry);
+    }
+}
+
+} // namespace imdb
@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2012 Mathias Eitz and Ronald Richter.
+All rights reserved.
+
+This file is part of the imdb library and is made available under
+the terms of the BSD license (see the LICENSE file).
+*/
+
+#ifndef VOCABULARY_TREE_HPP
+#define VOCABULARY_TREE_HPP
+
+#include "types.hpp"
+
+namespace imdb {
+
+/**
+ * @ingroup util
+ * @brief Hierarchical vocabulary ('vocabulary tree', Nister & Stewenius - Scalable Recognition with a Vocabulary Tree)
+ *
+ * Each inner node of the tree has up to b children, each child being represented by its center. The leaves of the tree
+ * are the visual words. A sample is quantized by descending from the root, at each level choosing the child with
+ * the closest center (under the squared L2 distance). Quantization thus costs O(b * depth * d) instead of
+ * O(K * d) for a flat vocabulary of size K, which makes vocabularies with millions of words practical.
+ *
+ * The children of a node are always stored contiguously. Word ids are assigned to the leaves in the
+ * order in which they are stored, i.e. they are stable under save()/load().
+ *
+ * Use hierarchical_kmeans() (see hierarchical_kmeans.hpp) to build a tree from a set of samples.
+ */
+class VocabularyTree
+{
+    public:
+
+    /// Creates an empty tree consisting of the root node only (which then is the single word).
+    VocabularyTree();
+
+    /// Removes all nodes but the root and sets the dimensionality of the centers
+    void clear(size_t dim);
+
+    /// @brief Adds children with the given centers to the leaf node parent. Must be called at most once per node.
+    /// @return Index of the first child, all children are stored contiguously
+    int32_t add_children(int32_t parent, const vec_vec_f32_t& centers);
+
+    /// Assigns word ids to all leaves, must be called after the last call to add_children()
+    void finalize();
+
+    /// Returns the word id of the leaf sample ends up in when descending the tree.
+    uint32_t quantize(const vec_f32_t& sample) const;
+
+    /// Centers of all leaves, words[i] is the center of the leaf with word id i. Use this if a
+    /// flat vocabulary is required, e.g. for its size or for a fallback to exhaustive quantization.
+    void words(vec_vec_f32_t& words) const;
+
+    size_t num_words() const { return _leaves.size(); }
+    size_t num_nodes() const { return _nodes.size(); }
+    size_t dim() const { return _dim; }
+
+    /// @brief Load a tree stored with save().
+    /// @throw std::runtime_error in case the file cannot be openend or is corrupt
+    void load(const string& filename);
+
+    /// @brief Stores the tree as a property file, with one element per node.
+    /// @throw std::runtime_error in case the file cannot be written
+    void save(const string& filename) const;
+
+    private:
+
+    struct node_t
+    {
+        int32_t first_child;
+        int32_t num_children;
+        int32_t word;
+    };
+
+    vector<node_t> _nodes;
+
+    // centers of all nodes, stored one after the other, i.e. the center of
+    // node i starts at _centers[i*_dim]. The root's center is unused
+    vec_f32_t _centers;
+    size_t    _dim;
+
+    // _leaves[w] = index of the node representing word w
+    vector<int32_t> _leaves;
+};
+
+} // namespace imdb
+
+#endif // VOCABULARY_TREE_HPP